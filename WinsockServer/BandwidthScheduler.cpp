@@ -0,0 +1,121 @@
+#include "BandwidthScheduler.h"
+#include "Utils.h"
+#include <algorithm>
+
+BandwidthScheduler::BandwidthScheduler(size_t quantum, size_t rateLimit) : quantum{ quantum }, rateLimit{ rateLimit } {
+
+	tokens		= 0.0;
+	lastRefill	= std::chrono::steady_clock::now();
+}
+
+BandwidthScheduler::Flow::Flow(BandwidthScheduler& scheduler, SOCKET connection) : scheduler{ scheduler }, connection{ connection }, backlog{ connection, bulkProfile } {
+
+	std::lock_guard<std::mutex> lock{ scheduler.mutex };
+
+	scheduler.ring.push_back(this);
+}
+
+BandwidthScheduler::Flow::~Flow() {
+
+	{
+		std::lock_guard<std::mutex> lock{ scheduler.mutex };
+
+		scheduler.ring.erase(std::find(scheduler.ring.begin(), scheduler.ring.end(), this));
+
+		scheduler.advance();
+	}
+
+	scheduler.turnChanged.notify_all();
+}
+
+// The write itself holds nothing. If it stalls past the send timeout, sendAll fails and the
+// caller drops the connection.
+bool BandwidthScheduler::Flow::send(const char* data, size_t size) {
+
+	while (size) {
+
+		size_t granted = scheduler.acquire(*this, size);
+
+		backlog.update();
+
+		if (!sendAll(connection, data, granted))
+			return false;
+
+		data += granted;
+
+		size -= granted;
+	}
+
+	return true;
+}
+
+void BandwidthScheduler::refill() {
+
+	auto now = std::chrono::steady_clock::now();
+
+	std::chrono::duration<double> elapsed = now - lastRefill;
+
+	double capacity = std::max(2.0 * quantum, rateLimit / 10.0);
+
+	tokens		= std::min(capacity, tokens + elapsed.count() * rateLimit);
+	lastRefill	= now;
+}
+
+size_t BandwidthScheduler::acquire(Flow& flow, size_t wanted) {
+
+	if (!rateLimit)
+		return std::min(wanted, quantum);
+
+	std::unique_lock<std::mutex> lock{ mutex };
+
+	flow.ready = true;
+
+	advance();
+
+	turnChanged.wait(lock, [&] { return ring.front() == &flow; });
+
+	flow.deficit += quantum;
+
+	size_t granted = std::min(wanted, flow.deficit);
+
+	refill();
+
+	while (tokens < granted) {
+
+		std::chrono::duration<double> missing{ (granted - tokens) / rateLimit };
+
+		turnChanged.wait_for(lock, missing);
+
+		refill();
+	}
+
+	tokens -= granted;
+
+	// A flow that has no more to send keeps no credit, as in deficit round robin.
+	flow.deficit	= granted == wanted ? 0 : flow.deficit - granted;
+	flow.ready		= false;
+
+	ring.push_back(ring.front());
+
+	ring.pop_front();
+
+	advance();
+
+	turnChanged.notify_all();
+
+	return granted;
+}
+
+// Passes the turn over flows that are writing rather than waiting for credit. They keep their
+// place in the ring but earn nothing for the turns they skip.
+void BandwidthScheduler::advance() {
+
+	for (size_t skipped = 0; skipped < ring.size() && !ring.front()->ready; skipped++) {
+
+		ring.front()->deficit = 0;
+
+		ring.push_back(ring.front());
+
+		ring.pop_front();
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <WinSock2.h>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "SocketProfile.h"
+
+// Shares a global egress rate cap between bulk transfers with deficit round robin. Every
+// transfer sends through a Flow. Flows waiting for credit take turns in a ring; each turn adds
+// one quantum to the flow's deficit and grants up to that, once the token bucket holds enough.
+// The scheduler only does the accounting: the socket write happens after the grant, with no
+// turn or slot held, so a stalled reader only holds up itself. Bulk sockets carry a send
+// timeout, and a flow whose write makes no progress in that time fails and is dropped. Without
+// a rate cap every grant is immediate and flows are only cut into quanta. Short control
+// responses are sent directly and never wait here.
+class BandwidthScheduler
+{
+public:
+
+	class Flow
+	{
+		BandwidthScheduler&		scheduler;
+		SOCKET					connection;
+		SendBacklogTracker		backlog;
+		size_t					deficit	= 0;
+		bool					ready	= false;
+
+		friend class BandwidthScheduler;
+
+	public:
+
+		Flow(BandwidthScheduler& scheduler, SOCKET connection);
+
+		~Flow();
+
+		Flow(const Flow& other)				= delete;
+
+		Flow& operator=(const Flow& other)	= delete;
+
+		bool send(const char* data, size_t size);
+	};
+
+private:
+
+	size_t									quantum;
+	size_t									rateLimit;
+
+	std::mutex								mutex;
+	std::condition_variable					turnChanged;
+	std::deque<Flow*>						ring;
+	double									tokens;
+	std::chrono::steady_clock::time_point	lastRefill;
+
+	size_t acquire(Flow& flow, size_t wanted);
+
+	void advance();
+
+	void refill();
+
+public:
+
+	BandwidthScheduler(size_t quantum, size_t rateLimit = 0);
+
+	BandwidthScheduler(const BandwidthScheduler& other)				= delete;
+
+	BandwidthScheduler& operator=(const BandwidthScheduler& other)	= delete;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <string>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// Bloom filter sized for a capacity and false positive rate. Adds and lookups may run
+// concurrently; bits are only ever set, with atomic ORs.
+class BloomFilter
+{
+	std::vector<std::atomic<uint64_t>>	words;
+	size_t								bitCount;
+	size_t								hashCount;
+	size_t								capacity;
+	std::atomic<size_t>					count{ 0 };
+
+	static uint64_t hash(const std::string& value) {
+
+		uint64_t hash = 0xCBF29CE484222325ULL;
+
+		for (unsigned char c : value) {
+
+			hash ^= c;
+
+			hash *= 0x100000001B3ULL;
+		}
+
+		return hash;
+	}
+
+	static uint64_t mix(uint64_t value) {
+
+		value += 0x9E3779B97F4A7C15ULL;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+
+		return value ^ (value >> 31);
+	}
+
+public:
+
+	BloomFilter(size_t capacity, double falsePositiveRate) :
+		words(static_cast<size_t>(std::ceil(-static_cast<double>(std::max<size_t>(capacity, 1)) * std::log(falsePositiveRate) / (std::log(2.0) * std::log(2.0)) / 64.0))),
+		capacity{ capacity } {
+
+		bitCount	= std::max<size_t>(words.size(), 1) * 64;
+		hashCount	= std::max<size_t>(1, static_cast<size_t>(std::round(static_cast<double>(bitCount) / std::max<size_t>(capacity, 1) * std::log(2.0))));
+
+		if (words.empty())
+			words = std::vector<std::atomic<uint64_t>>(1);
+	}
+
+	void add(const std::string& value) {
+
+		uint64_t first = hash(value), second = mix(first) | 1;
+
+		for (size_t i = 0; i < hashCount; i++) {
+
+			size_t bit = static_cast<size_t>((first + i * second) % bitCount);
+
+			words[bit / 64].fetch_or(1ULL << (bit % 64), std::memory_order_relaxed);
+		}
+
+		count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool mightContain(const std::string& value) const {
+
+		uint64_t first = hash(value), second = mix(first) | 1;
+
+		for (size_t i = 0; i < hashCount; i++) {
+
+			size_t bit = static_cast<size_t>((first + i * second) % bitCount);
+
+			if (!(words[bit / 64].load(std::memory_order_relaxed) & (1ULL << (bit % 64))))
+				return false;
+		}
+
+		return true;
+	}
+
+	size_t getCapacity() const {
+		return capacity;
+	}
+
+	// Past its capacity the false positive rate climbs towards one.
+	bool isSaturated() const {
+		return count.load(std::memory_order_relaxed) > capacity;
+	}
+};
@@ -0,0 +1,119 @@
+#include "ChaCha20.h"
+#include "Crypto.h"
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+	inline uint32_t rotate(uint32_t value, int bits) {
+
+		return (value << bits) | (value >> (32 - bits));
+	}
+
+	inline void quarterRound(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d) {
+
+		a += b; d ^= a; d = rotate(d, 16);
+		c += d; b ^= c; b = rotate(b, 12);
+		a += b; d ^= a; d = rotate(d, 8);
+		c += d; b ^= c; b = rotate(b, 7);
+	}
+}
+
+ChaCha20::ChaCha20() {
+
+	auto seed = randomBytes(44);
+
+	state[0] = 0x61707865;
+	state[1] = 0x3320646e;
+	state[2] = 0x79622d32;
+	state[3] = 0x6b206574;
+
+	std::memcpy(&state[4], seed.data(), 32);
+
+	state[12] = 0;
+
+	std::memcpy(&state[13], seed.data() + 32, 12);
+}
+
+// Four blocks are computed per refill with the rounds interleaved across them, which gives
+// the compiler independent lanes to vectorize.
+void ChaCha20::refill() {
+
+	constexpr size_t lanes = sizeof(buffer) / 64;
+
+	uint32_t working[lanes][16];
+
+	for (size_t lane = 0; lane < lanes; lane++) {
+
+		std::memcpy(working[lane], state.data(), sizeof(working[lane]));
+
+		working[lane][12] += static_cast<uint32_t>(lane);
+	}
+
+	for (int round = 0; round < 10; round++) {
+
+		for (auto& x : working) {
+
+			quarterRound(x[0], x[4], x[8], x[12]);
+			quarterRound(x[1], x[5], x[9], x[13]);
+			quarterRound(x[2], x[6], x[10], x[14]);
+			quarterRound(x[3], x[7], x[11], x[15]);
+		}
+
+		for (auto& x : working) {
+
+			quarterRound(x[0], x[5], x[10], x[15]);
+			quarterRound(x[1], x[6], x[11], x[12]);
+			quarterRound(x[2], x[7], x[8], x[13]);
+			quarterRound(x[3], x[4], x[9], x[14]);
+		}
+	}
+
+	for (size_t lane = 0; lane < lanes; lane++) {
+
+		for (size_t i = 0; i < 16; i++) {
+
+			uint32_t word = working[lane][i] + state[i] + (i == 12 ? static_cast<uint32_t>(lane) : 0);
+
+			buffer[lane * 64 + i * 4 + 0] = static_cast<unsigned char>(word);
+			buffer[lane * 64 + i * 4 + 1] = static_cast<unsigned char>(word >> 8);
+			buffer[lane * 64 + i * 4 + 2] = static_cast<unsigned char>(word >> 16);
+			buffer[lane * 64 + i * 4 + 3] = static_cast<unsigned char>(word >> 24);
+		}
+	}
+
+	state[12] += static_cast<uint32_t>(lanes);
+
+	position = 0;
+}
+
+void ChaCha20::fill(unsigned char* data, size_t size) {
+
+	while (size) {
+
+		if (position == buffer.size())
+			refill();
+
+		size_t length = std::min(size, buffer.size() - position);
+
+		std::memcpy(data, buffer.data() + position, length);
+
+		std::memset(buffer.data() + position, 0, length);
+
+		position	+= length;
+		data		+= length;
+		size		-= length;
+	}
+}
+
+unsigned char ChaCha20::next() {
+
+	if (position == buffer.size())
+		refill();
+
+	unsigned char value = buffer[position];
+
+	buffer[position++] = 0;
+
+	return value;
+}
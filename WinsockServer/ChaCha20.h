@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+
+// ChaCha20 keystream used as a CSPRNG. The key comes from the system RNG; a block of 64
+// bytes is produced per counter value, so one BCrypt call seeds an arbitrarily long stream.
+class ChaCha20
+{
+	std::array<uint32_t, 16>		state{};
+	std::array<unsigned char, 256>	buffer{};
+	size_t							position = sizeof(buffer);
+
+	void refill();
+
+public:
+
+	ChaCha20();
+
+	void fill(unsigned char* data, size_t size);
+
+	unsigned char next();
+};
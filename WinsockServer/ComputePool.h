@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <string>
+#include "Metrics.h"
+
+// Fixed set of threads for CPU heavy work, so it runs beside the connection threads instead
+// of on them. The queue is bounded; submit() waits for room when it is full. Queue wait and
+// run times are recorded under the pool's name in Metrics.
+class ComputePool
+{
+	struct Task {
+
+		std::function<void()>					work;
+		std::chrono::steady_clock::time_point	queuedAt;
+	};
+
+	size_t								maxQueued;
+
+	std::mutex							mutex;
+	std::condition_variable				taskReady;
+	std::condition_variable				roomReady;
+	std::deque<Task>					tasks;
+	bool								running = true;
+	std::vector<std::thread>			workers;
+
+	std::atomic<long long>&				completed;
+	std::atomic<long long>&				queueWaitMicros;
+	std::atomic<long long>&				runMicros;
+	std::atomic<long long>&				maxQueueWaitMicros;
+	std::atomic<long long>&				maxDepth;
+
+	void work() {
+
+		while (true) {
+
+			Task task;
+
+			{
+				std::unique_lock<std::mutex> lock{ mutex };
+
+				taskReady.wait(lock, [&] { return !running || !tasks.empty(); });
+
+				if (tasks.empty())
+					return;
+
+				task = std::move(tasks.front());
+
+				tasks.pop_front();
+			}
+
+			roomReady.notify_one();
+
+			auto started = std::chrono::steady_clock::now();
+
+			task.work();
+
+			auto finished = std::chrono::steady_clock::now();
+
+			long long waited = std::chrono::duration_cast<std::chrono::microseconds>(started - task.queuedAt).count();
+
+			completed++;
+
+			queueWaitMicros += waited;
+
+			runMicros += std::chrono::duration_cast<std::chrono::microseconds>(finished - started).count();
+
+			Metrics::setMax(maxQueueWaitMicros, waited);
+		}
+	}
+
+public:
+
+	ComputePool(const std::string& name, size_t threads, size_t maxQueued) :
+		maxQueued{ maxQueued },
+		completed{ metrics.get(name + ".completed") },
+		queueWaitMicros{ metrics.get(name + ".queue_wait_us") },
+		runMicros{ metrics.get(name + ".run_us") },
+		maxQueueWaitMicros{ metrics.get(name + ".max_queue_wait_us") },
+		maxDepth{ metrics.get(name + ".max_depth") } {
+
+		for (size_t i = 0; i < threads; i++)
+			workers.emplace_back(&ComputePool::work, this);
+	}
+
+	~ComputePool() {
+
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+
+			running = false;
+		}
+
+		taskReady.notify_all();
+
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	ComputePool(const ComputePool& other)				= delete;
+
+	ComputePool& operator=(const ComputePool& other)	= delete;
+
+	template <typename Function>
+	auto submit(Function function) -> std::future<decltype(function())> {
+
+		auto task = std::make_shared<std::packaged_task<decltype(function())()>>(std::move(function));
+
+		auto result = task->get_future();
+
+		{
+			std::unique_lock<std::mutex> lock{ mutex };
+
+			roomReady.wait(lock, [&] { return tasks.size() < maxQueued; });
+
+			tasks.push_back({ [task] { (*task)(); }, std::chrono::steady_clock::now() });
+
+			Metrics::setMax(maxDepth, static_cast<long long>(tasks.size()));
+		}
+
+		taskReady.notify_one();
+
+		return result;
+	}
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <atomic>
+#include "Metrics.h"
+
+// Caps how many requests are handled at once and adapts the cap to observed latency, in the
+// style of a gradient limiter: a slow moving average of latency is the baseline, and when
+// recent requests take longer than that (beyond a tolerance) the limit shrinks in proportion.
+// While latency holds, the limit grows by roughly its square root per adjustment.
+//
+// Requests over the limit wait in one queue per priority class (0 is most urgent) and are
+// admitted as permits are released. A waiter's class improves by one for every aging
+// interval it has waited, so low classes are never starved. Requests are shed when the
+// queue is full or they wait longer than maxWait.
+class ConcurrencyLimiter
+{
+public:
+
+	class Permit
+	{
+		ConcurrencyLimiter*						limiter;
+		std::chrono::steady_clock::time_point	started;
+
+	public:
+
+		explicit Permit(ConcurrencyLimiter* limiter) : limiter{ limiter }, started{ std::chrono::steady_clock::now() } {}
+
+		~Permit() {
+
+			release();
+		}
+
+		Permit(Permit&& other) noexcept : limiter{ other.limiter }, started{ other.started } {
+
+			other.limiter = nullptr;
+		}
+
+		Permit(const Permit& other)				= delete;
+
+		Permit& operator=(const Permit& other)	= delete;
+
+		explicit operator bool() const {
+			return limiter != nullptr;
+		}
+
+		void release() {
+
+			if (limiter)
+				limiter->complete(std::chrono::steady_clock::now() - started);
+
+			limiter = nullptr;
+		}
+	};
+
+private:
+
+	std::mutex					mutex;
+	double						limit;
+	double						minLimit;
+	double						maxLimit;
+	double						tolerance;
+	double						longLatency	= 0.0;
+	double						shortLatency	= 0.0;
+	long long					inFlight	= 0;
+
+	struct Waiter {
+
+		std::condition_variable					ready;
+		std::chrono::steady_clock::time_point	enqueuedAt;
+		bool									granted = false;
+	};
+
+	struct PriorityClass {
+
+		std::deque<Waiter*>			waiters;
+
+		std::atomic<long long>*		depth;
+		std::atomic<long long>*		maxDepth;
+		std::atomic<long long>*		waited;
+		std::atomic<long long>*		waitMicros;
+		std::atomic<long long>*		timeouts;
+	};
+
+	std::vector<PriorityClass>				classes;
+	size_t									queued		= 0;
+	size_t									maxQueued;
+	std::chrono::steady_clock::duration		maxWait;
+	std::chrono::steady_clock::duration		agingInterval;
+
+	std::atomic<long long>&		admitted;
+	std::atomic<long long>&		shed;
+	std::atomic<long long>&		currentLimit;
+
+	// Picks the waiter with the best class once aging is taken into account; among equals the
+	// one that has waited longest wins.
+	void grantWaiters() {
+
+		auto now = std::chrono::steady_clock::now();
+
+		while (queued && inFlight < static_cast<long long>(limit)) {
+
+			PriorityClass* best = nullptr;
+
+			double bestRank = 0.0;
+
+			for (size_t i = 0; i < classes.size(); i++) {
+
+				if (classes[i].waiters.empty())
+					continue;
+
+				double rank = static_cast<double>(i) - static_cast<double>((now - classes[i].waiters.front()->enqueuedAt).count()) / agingInterval.count();
+
+				if (!best || rank < bestRank) {
+
+					best		= &classes[i];
+					bestRank	= rank;
+				}
+			}
+
+			Waiter* waiter = best->waiters.front();
+
+			best->waiters.pop_front();
+
+			queued--;
+
+			(*best->depth)--;
+
+			inFlight++;
+
+			waiter->granted = true;
+
+			waiter->ready.notify_one();
+		}
+	}
+
+	void complete(std::chrono::steady_clock::duration latency) {
+
+		double sample = std::chrono::duration<double, std::micro>(latency).count();
+
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		bool saturated = inFlight >= limit / 2;
+
+		inFlight--;
+
+		if (longLatency == 0.0)
+			longLatency = shortLatency = sample;
+
+		shortLatency	= shortLatency * 0.9 + sample * 0.1;
+		longLatency		= longLatency * 0.995 + sample * 0.005;
+
+		double gradient = std::clamp(tolerance * longLatency / shortLatency, 0.5, 1.0);
+
+		// Don't grow the limit while there isn't enough traffic to test it.
+		if (gradient == 1.0 && !saturated) {
+
+			grantWaiters();
+
+			return;
+		}
+
+		double newLimit = limit * gradient + std::sqrt(limit);
+
+		limit = std::clamp(limit * 0.8 + newLimit * 0.2, minLimit, maxLimit);
+
+		currentLimit = static_cast<long long>(limit);
+
+		grantWaiters();
+	}
+
+public:
+
+	ConcurrencyLimiter(const std::string& name, double initialLimit, double minLimit, double maxLimit, size_t classCount, size_t maxQueued,
+		std::chrono::milliseconds maxWait, std::chrono::milliseconds agingInterval, double tolerance = 1.5) :
+		limit{ initialLimit }, minLimit{ minLimit }, maxLimit{ maxLimit }, tolerance{ tolerance },
+		classes(classCount), maxQueued{ maxQueued }, maxWait{ maxWait }, agingInterval{ agingInterval },
+		admitted{ metrics.get(name + ".admitted") },
+		shed{ metrics.get(name + ".shed") },
+		currentLimit{ metrics.get(name + ".limit") } {
+
+		currentLimit = static_cast<long long>(limit);
+
+		for (size_t i = 0; i < classes.size(); i++) {
+
+			std::string prefix = name + ".class" + std::to_string(i);
+
+			classes[i].depth		= &metrics.get(prefix + ".depth");
+			classes[i].maxDepth		= &metrics.get(prefix + ".max_depth");
+			classes[i].waited		= &metrics.get(prefix + ".waited");
+			classes[i].waitMicros	= &metrics.get(prefix + ".wait_us");
+			classes[i].timeouts		= &metrics.get(prefix + ".timeouts");
+		}
+	}
+
+	ConcurrencyLimiter(const ConcurrencyLimiter& other)				= delete;
+
+	ConcurrencyLimiter& operator=(const ConcurrencyLimiter& other)	= delete;
+
+	Permit acquire(size_t priorityClass) {
+
+		std::unique_lock<std::mutex> lock{ mutex };
+
+		if (!queued && inFlight < static_cast<long long>(limit)) {
+
+			inFlight++;
+
+			admitted++;
+
+			return Permit{ this };
+		}
+
+		auto& waitClass = classes[std::min(priorityClass, classes.size() - 1)];
+
+		if (queued >= maxQueued) {
+
+			shed++;
+
+			return Permit{ nullptr };
+		}
+
+		Waiter waiter;
+
+		waiter.enqueuedAt = std::chrono::steady_clock::now();
+
+		waitClass.waiters.push_back(&waiter);
+
+		queued++;
+
+		Metrics::setMax(*waitClass.maxDepth, ++(*waitClass.depth));
+
+		bool granted = waiter.ready.wait_for(lock, maxWait, [&] { return waiter.granted; });
+
+		(*waitClass.waited)++;
+
+		*waitClass.waitMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waiter.enqueuedAt).count();
+
+		if (!granted) {
+
+			waitClass.waiters.erase(std::find(waitClass.waiters.begin(), waitClass.waiters.end(), &waiter));
+
+			queued--;
+
+			(*waitClass.depth)--;
+
+			(*waitClass.timeouts)++;
+
+			shed++;
+
+			return Permit{ nullptr };
+		}
+
+		admitted++;
+
+		return Permit{ this };
+	}
+};
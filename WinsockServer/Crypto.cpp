@@ -0,0 +1,160 @@
+#include "Crypto.h"
+
+Sha256::Sha256() {
+
+	NTSTATUS status = BCryptCreateHash(BCRYPT_SHA256_ALG_HANDLE, &hash, nullptr, 0, nullptr, 0, 0);
+
+	if (!BCRYPT_SUCCESS(status))
+		throw std::runtime_error("BCryptCreateHash failed with status " + std::to_string(status));
+}
+
+Sha256::~Sha256() {
+
+	if (hash)
+		BCryptDestroyHash(hash);
+}
+
+void Sha256::update(const char* data, size_t size) {
+
+	while (size) {
+
+		ULONG block = static_cast<ULONG>(size > 0x40000000 ? 0x40000000 : size);
+
+		NTSTATUS status = BCryptHashData(hash, reinterpret_cast<PUCHAR>(const_cast<char*>(data)), block, 0);
+
+		if (!BCRYPT_SUCCESS(status))
+			throw std::runtime_error("BCryptHashData failed with status " + std::to_string(status));
+
+		data += block;
+
+		size -= block;
+	}
+}
+
+Digest Sha256::finish() {
+
+	Digest digest{};
+
+	NTSTATUS status = BCryptFinishHash(hash, digest.data(), static_cast<ULONG>(digest.size()), 0);
+
+	if (!BCRYPT_SUCCESS(status))
+		throw std::runtime_error("BCryptFinishHash failed with status " + std::to_string(status));
+
+	return digest;
+}
+
+Digest sha256(const char* data, size_t size) {
+
+	Sha256 hash;
+
+	hash.update(data, size);
+
+	return hash.finish();
+}
+
+Digest hmacSha256(const std::vector<unsigned char>& key, const std::string& data) {
+
+	Digest digest{};
+
+	NTSTATUS status = BCryptHash(BCRYPT_HMAC_SHA256_ALG_HANDLE,
+		const_cast<PUCHAR>(key.data()), static_cast<ULONG>(key.size()),
+		reinterpret_cast<PUCHAR>(const_cast<char*>(data.data())), static_cast<ULONG>(data.size()),
+		digest.data(), static_cast<ULONG>(digest.size()));
+
+	if (!BCRYPT_SUCCESS(status))
+		throw std::runtime_error("BCryptHash failed with status " + std::to_string(status));
+
+	return digest;
+}
+
+std::string toHex(const unsigned char* data, size_t size) {
+
+	static const char digits[] = "0123456789abcdef";
+
+	std::string hex;
+
+	hex.reserve(size * 2);
+
+	for (size_t i = 0; i < size; i++) {
+
+		hex.push_back(digits[data[i] >> 4]);
+
+		hex.push_back(digits[data[i] & 0xF]);
+	}
+
+	return hex;
+}
+
+bool fromHex(const std::string& hex, std::vector<unsigned char>& bytes) {
+
+	if (hex.length() % 2)
+		return false;
+
+	auto digit = [](char c) {
+
+		if (c >= '0' && c <= '9')
+			return c - '0';
+
+		if (c >= 'a' && c <= 'f')
+			return c - 'a' + 10;
+
+		if (c >= 'A' && c <= 'F')
+			return c - 'A' + 10;
+
+		return -1;
+	};
+
+	bytes.clear();
+
+	for (size_t i = 0; i < hex.length(); i += 2) {
+
+		int high = digit(hex[i]), low = digit(hex[i + 1]);
+
+		if (high < 0 || low < 0)
+			return false;
+
+		bytes.push_back(static_cast<unsigned char>(high << 4 | low));
+	}
+
+	return true;
+}
+
+std::vector<unsigned char> randomBytes(size_t size) {
+
+	std::vector<unsigned char> bytes(size);
+
+	NTSTATUS status = BCryptGenRandom(nullptr, bytes.data(), static_cast<ULONG>(bytes.size()), BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+
+	if (!BCRYPT_SUCCESS(status))
+		throw std::runtime_error("BCryptGenRandom failed with status " + std::to_string(status));
+
+	return bytes;
+}
+
+std::vector<unsigned char> pbkdf2Sha256(const std::string& password, const std::vector<unsigned char>& salt, ULONGLONG iterations, size_t size) {
+
+	std::vector<unsigned char> key(size);
+
+	NTSTATUS status = BCryptDeriveKeyPBKDF2(BCRYPT_HMAC_SHA256_ALG_HANDLE,
+		reinterpret_cast<PUCHAR>(const_cast<char*>(password.data())), static_cast<ULONG>(password.size()),
+		const_cast<PUCHAR>(salt.data()), static_cast<ULONG>(salt.size()),
+		iterations, key.data(), static_cast<ULONG>(key.size()), 0);
+
+	if (!BCRYPT_SUCCESS(status))
+		throw std::runtime_error("BCryptDeriveKeyPBKDF2 failed with status " + std::to_string(status));
+
+	return key;
+}
+
+bool constantTimeEqual(const std::vector<unsigned char>& first, const std::vector<unsigned char>& second) {
+
+	if (first.size() != second.size())
+		return false;
+
+	unsigned char difference = 0;
+
+	for (size_t i = 0; i < first.size(); i++)
+		difference |= first[i] ^ second[i];
+
+	return difference == 0;
+}
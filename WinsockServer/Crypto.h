@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Windows.h>
+#include <bcrypt.h>
+#include <array>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#pragma comment (lib, "bcrypt.lib")
+
+using Digest = std::array<unsigned char, 32>;
+
+class Sha256
+{
+	BCRYPT_HASH_HANDLE		hash = nullptr;
+
+public:
+
+	Sha256();
+
+	~Sha256();
+
+	Sha256(const Sha256& other)				= delete;
+
+	Sha256& operator=(const Sha256& other)	= delete;
+
+	void update(const char* data, size_t size);
+
+	Digest finish();
+};
+
+Digest sha256(const char* data, size_t size);
+
+Digest hmacSha256(const std::vector<unsigned char>& key, const std::string& data);
+
+std::string toHex(const unsigned char* data, size_t size);
+
+bool fromHex(const std::string& hex, std::vector<unsigned char>& bytes);
+
+std::vector<unsigned char> randomBytes(size_t size);
+
+std::vector<unsigned char> pbkdf2Sha256(const std::string& password, const std::vector<unsigned char>& salt, ULONGLONG iterations, size_t size);
+
+bool constantTimeEqual(const std::vector<unsigned char>& first, const std::vector<unsigned char>& second);
@@ -1 +1 @@
-#include "Database.h"
+#include "Database.h"
@@ -1,192 +1,592 @@
-#pragma once
-
-#include "sqlite3.h"
-#include <string>
-#include <stdexcept>
-#include <optional>
-
-class Database
-{
-	sqlite3* sql = nullptr;
-	std::string name;
-
-public:
-	
-	Database(const std::string& databaseName) : name{ databaseName } {
-
-		if (sqlite3_open_v2(databaseName.c_str(), &sql, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, nullptr) != SQLITE_OK) {
-			throw std::runtime_error("sqlite3_open_v2 failed with code " + std::to_string(sqlite3_errcode(sql)));
-		}
-
-		std::string userTable {
-			"CREATE TABLE IF NOT EXISTS users("
-			"name		VARCHAR(50)	   NOT NULL, "
-			"password	VARCHAR(50)	   NOT NULL, "
-			"code		VARCHAR(50)	   NOT NULL)"
-		};
-
-		char* msg = nullptr;
-
-		if (sqlite3_exec(sql, userTable.c_str(), nullptr, nullptr, &msg) != SQLITE_OK) {
-			
-			std::string error = msg;
-
-			sqlite3_free(msg);
-
-			sqlite3_close_v2(sql);
-
-			throw std::runtime_error("sqlite3_exec failed with message " + error);
-		}
-
-		std::string keyTable {
-			"CREATE TABLE IF NOT EXISTS keys("
-			"name		   VARCHAR(50)  NOT NULL, "
-			"used		   INT          NOT NULL, "
-			"valid		   INT 			NOT NULL, "
-			"lastValidated DATE)"
-		};
-
-		if (sqlite3_exec(sql, keyTable.c_str(), nullptr, nullptr, &msg) != SQLITE_OK) {
-
-			std::string error = msg;
-
-			sqlite3_free(msg);
-
-			sqlite3_close_v2(sql);
-
-			throw std::runtime_error("sqlite3_exec failed with message " + error);
-		}
-
-		sqlite3_close_v2(sql);
-	}
-
-	void open() {
-
-		if (sqlite3_open_v2(name.c_str(), &sql, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, nullptr) != SQLITE_OK) {
-
-			throw std::runtime_error("sqlite3_open_v2 failed with code " + std::to_string(sqlite3_errcode(sql)));
-		}
-	}
-
-	std::string addKey(const std::string& key) {
-
-		if (key.length() < 8)
-			return std::string("Key too short");
-
-		if (key.length() > 25)
-			return std::string("Key too long");
-
-		std::string query{
-		"SELECT name FROM keys WHERE name = ?;"
-		};
-
-		sqlite3_stmt* stmt;
-
-		if (sqlite3_prepare_v2(sql, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
-			throw std::runtime_error("sqlite3_prepare_v2 failed with message " + std::to_string(sqlite3_errcode(sql)));
-
-		if (sqlite3_bind_text(stmt, 1, key.c_str(), -1, nullptr) != SQLITE_OK) {
-
-			sqlite3_finalize(stmt);
-
-			throw std::runtime_error("sqlite3_bind_text failed with message " + std::to_string(sqlite3_errcode(sql)));
-		}
-
-		int status = sqlite3_step(stmt);
-
-		if (status != SQLITE_ROW && status != SQLITE_DONE) {
-
-			sqlite3_finalize(stmt);
-
-			throw std::runtime_error("sqlite3_step failed with message " + std::to_string(sqlite3_errcode(sql)));
-		}
-
-		if (status == SQLITE_ROW) {
-
-			sqlite3_finalize(stmt);
-
-			return std::string("Key already exists");
-		}
-
-		sqlite3_finalize(stmt);
-
-		query = "INSERT INTO keys VALUES(?, 0, 0, NULL);";
-
-		if (sqlite3_prepare_v2(sql, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
-			throw std::runtime_error("sqlite3_prepare_v2 failed with code " + std::string(sqlite3_errmsg(sql)));
-
-		if (sqlite3_bind_text(stmt, 1, key.c_str(), -1, nullptr) != SQLITE_OK) {
-
-			sqlite3_finalize(stmt);
-
-			throw std::runtime_error("sqlite3_bind_text failed with message " + std::to_string(sqlite3_errcode(sql)));
-		}
-
-		if (sqlite3_step(stmt) != SQLITE_DONE) {
-
-			sqlite3_finalize(stmt);
-
-			throw std::runtime_error("sqlite3_step failed with message " + std::to_string(sqlite3_errcode(sql)));
-		}
-		
-		sqlite3_finalize(stmt);
-
-		return std::string("Key added");
-	}
-
-	std::optional<std::vector<std::string>> invalidate() {
-		
-		std::string query{
-			"SELECT name FROM keys WHERE valid = 1 AND julianday('now') - julianday(lastValidated) >= 30;"
-		};
-
-		sqlite3_stmt* stmt;
-
-		if (sqlite3_prepare_v2(sql, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
-			throw std::runtime_error("sqlite3_prepare_v2 failed with code " + std::string(sqlite3_errmsg(sql)));
-
-		int ret{};
-
-		std::vector<std::string> names;
-
-		while ((ret = sqlite3_step(stmt)) == SQLITE_ROW) {
-
-			names.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
-		}
-
-		sqlite3_finalize(stmt);
-
-		if (names.empty())
-			return {};
-
-		query = "UPDATE keys SET valid = 0 WHERE valid = 1 AND julianday('now') - julianday(lastValidated) >= 30;";
-		
-		char* msg;
-
-		if (sqlite3_exec(sql, query.c_str(), nullptr, nullptr, &msg) != SQLITE_OK) {
-
-			std::string error = msg;
-
-			sqlite3_free(msg);
-
-			throw std::runtime_error("sqlite3_exec failed with message " + error);
-		}
-
-		return names;
-	}
-
-	void close() {
-
-		sqlite3_close_v2(sql);
-	}
-
-	Database(const Database& other)				= delete;
-
-	Database& operator=(const Database& other)	= delete;
-
-	sqlite3* get() const {
-
-		return sql;
-	}
-};
-
+#pragma once
+
+#include "sqlite3.h"
+#include <string>
+#include <stdexcept>
+#include <optional>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <iostream>
+#include "Storage.h"
+#include "WriteQueue.h"
+
+// SQLite backend. Lookups are spread over a small pool of read connections; every write goes
+// through the write queue, so concurrent writes share a commit.
+class Database : public Storage
+{
+	using Statement = std::unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)>;
+
+	sqlite3*					sql = nullptr;
+	std::vector<sqlite3*>		readers;
+	std::atomic<size_t>			nextReader{ 0 };
+	std::string					name;
+	std::unique_ptr<WriteQueue>	writes;
+
+	static sqlite3* connect(const std::string& databaseName) {
+
+		sqlite3* connection = nullptr;
+
+		if (sqlite3_open_v2(databaseName.c_str(), &connection, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, nullptr) != SQLITE_OK) {
+
+			std::string error = std::to_string(sqlite3_errcode(connection));
+
+			sqlite3_close_v2(connection);
+
+			throw std::runtime_error("sqlite3_open_v2 failed with code " + error);
+		}
+
+		sqlite3_busy_timeout(connection, 5000);
+
+		return connection;
+	}
+
+	sqlite3* reader() {
+
+		return readers[nextReader++ % readers.size()];
+	}
+
+	static void execute(sqlite3* sql, const std::string& query) {
+
+		char* msg = nullptr;
+
+		if (sqlite3_exec(sql, query.c_str(), nullptr, nullptr, &msg) != SQLITE_OK) {
+
+			std::string error = msg;
+
+			sqlite3_free(msg);
+
+			throw std::runtime_error("sqlite3_exec failed with message " + error);
+		}
+	}
+
+	static Statement prepare(sqlite3* sql, const std::string& query) {
+
+		sqlite3_stmt* stmt = nullptr;
+
+		if (sqlite3_prepare_v2(sql, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+			throw std::runtime_error("sqlite3_prepare_v2 failed with message " + std::string(sqlite3_errmsg(sql)));
+
+		return Statement{ stmt, sqlite3_finalize };
+	}
+
+	static void bind(sqlite3* sql, sqlite3_stmt* stmt, int index, const std::string& value) {
+
+		if (sqlite3_bind_text(stmt, index, value.c_str(), static_cast<int>(value.length()), SQLITE_TRANSIENT) != SQLITE_OK)
+			throw std::runtime_error("sqlite3_bind_text failed with message " + std::to_string(sqlite3_errcode(sql)));
+	}
+
+	static bool step(sqlite3* sql, sqlite3_stmt* stmt) {
+
+		int status = sqlite3_step(stmt);
+
+		if (status != SQLITE_ROW && status != SQLITE_DONE)
+			throw std::runtime_error("sqlite3_step failed with message " + std::to_string(sqlite3_errcode(sql)));
+
+		return status == SQLITE_ROW;
+	}
+
+	static std::string text(sqlite3_stmt* stmt, int column) {
+
+		auto value = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+
+		return value ? value : "";
+	}
+
+	void addColumn(const std::string& table, const std::string& column, const std::string& definition) {
+
+		auto stmt = prepare(sql, "SELECT name FROM pragma_table_info('" + table + "') WHERE name = ?;");
+
+		bind(sql, stmt.get(), 1, column);
+
+		if (step(sql, stmt.get()))
+			return;
+
+		execute(sql, "ALTER TABLE " + table + " ADD COLUMN " + column + " " + definition + ";");
+	}
+
+	void createSchema() {
+
+		execute(sql,
+			"CREATE TABLE IF NOT EXISTS users("
+			"name		VARCHAR(50)	   NOT NULL, "
+			"password	VARCHAR(50)	   NOT NULL, "
+			"code		VARCHAR(50)	   NOT NULL)");
+
+		execute(sql,
+			"CREATE TABLE IF NOT EXISTS keys("
+			"name		   VARCHAR(50)  NOT NULL, "
+			"used		   INT          NOT NULL, "
+			"valid		   INT 			NOT NULL, "
+			"lastValidated DATE, "
+			"product	   VARCHAR(50)  NOT NULL DEFAULT 'dawn', "
+			"channel	   VARCHAR(50)  NOT NULL DEFAULT 'stable', "
+			"expiresAt	   INTEGER)");
+
+		addColumn("keys", "product", "VARCHAR(50) NOT NULL DEFAULT 'dawn'");
+
+		addColumn("keys", "channel", "VARCHAR(50) NOT NULL DEFAULT 'stable'");
+
+		addColumn("keys", "expiresAt", "INTEGER");
+
+		execute(sql,
+			"UPDATE keys SET expiresAt = CAST(strftime('%s', lastValidated) AS INTEGER) + " + std::to_string(keyLifetime) + " "
+			"WHERE expiresAt IS NULL AND lastValidated IS NOT NULL;"
+			"CREATE INDEX IF NOT EXISTS keysExpiresAt ON keys(expiresAt) WHERE valid = 1;");
+
+		uniqueKeyNames();
+	}
+
+	long long count(const std::string& query) {
+
+		auto stmt = prepare(sql, query);
+
+		return step(sql, stmt.get()) ? sqlite3_column_int64(stmt.get(), 0) : 0;
+	}
+
+	// One time migration for databases from before key names were unique. Of each set of
+	// duplicate rows the used, then valid, then latest expiring one is kept, so a claimed key
+	// can't come back as claimable. Duplicates that disagree on the entitlement have no safe
+	// winner and stop the server until they are fixed by hand.
+	void uniqueKeyNames() {
+
+		if (count("SELECT COUNT(*) FROM sqlite_master WHERE type = 'index' AND name = 'keysName';"))
+			return;
+
+		execute(sql, "BEGIN IMMEDIATE;");
+
+		try {
+
+			long long conflicting = count("SELECT COUNT(*) FROM (SELECT name FROM keys GROUP BY name HAVING COUNT(DISTINCT product || '/' || channel) > 1);");
+
+			if (conflicting)
+				throw std::runtime_error(std::to_string(conflicting) + " keys have duplicate rows with different products or channels");
+
+			long long differing	= count("SELECT COUNT(*) FROM (SELECT name FROM keys GROUP BY name HAVING COUNT(*) > 1 AND (MIN(used) != MAX(used) OR MIN(valid) != MAX(valid)));");
+			long long removed	= count("SELECT COUNT(*) - COUNT(DISTINCT name) FROM keys;");
+
+			execute(sql,
+				"DELETE FROM keys WHERE rowid IN (SELECT rowid FROM ("
+				"SELECT rowid, ROW_NUMBER() OVER (PARTITION BY name ORDER BY used DESC, valid DESC, expiresAt DESC, rowid) AS rank FROM keys) "
+				"WHERE rank > 1);"
+				"CREATE UNIQUE INDEX keysName ON keys(name);"
+				"COMMIT;");
+
+			if (removed)
+				std::cout << "Removed " << removed << " duplicate key rows, " << differing << " keys had copies with different used or valid flags.\n";
+		}
+		catch (...) {
+
+			sqlite3_exec(sql, "ROLLBACK;", nullptr, nullptr, nullptr);
+
+			throw;
+		}
+	}
+
+protected:
+
+	std::vector<bool> insertKeys(const std::vector<std::string>& keys) override {
+
+		return writes->submit([&](sqlite3* sql) {
+
+			auto stmt = prepare(sql, "INSERT OR IGNORE INTO keys (name, used, valid, lastValidated) VALUES(?, 0, 0, NULL);");
+
+			std::vector<bool> added;
+
+			for (const auto& key : keys) {
+
+				sqlite3_reset(stmt.get());
+
+				bind(sql, stmt.get(), 1, key);
+
+				step(sql, stmt.get());
+
+				added.push_back(sqlite3_changes(sql) != 0);
+			}
+
+			return added;
+
+		}).get();
+	}
+
+	std::vector<bool> extendKeys(const std::vector<std::string>& keys, long long expiresAt) override {
+
+		return writes->submit([&](sqlite3* sql) {
+
+			auto stmt = prepare(sql, "UPDATE keys SET valid = 1, lastValidated = date('now'), expiresAt = ? WHERE name = ?;");
+
+			std::vector<bool> extended;
+
+			for (const auto& key : keys) {
+
+				sqlite3_reset(stmt.get());
+
+				sqlite3_bind_int64(stmt.get(), 1, expiresAt);
+
+				bind(sql, stmt.get(), 2, key);
+
+				step(sql, stmt.get());
+
+				extended.push_back(sqlite3_changes(sql) != 0);
+			}
+
+			return extended;
+
+		}).get();
+	}
+
+	std::vector<bool> extendUserKeys(const std::vector<std::string>& users, long long expiresAt, std::vector<std::string>& codes) override {
+
+		return writes->submit([&](sqlite3* sql) {
+
+			auto select = prepare(sql, "SELECT code FROM users WHERE name = ?;");
+
+			auto update = prepare(sql, "UPDATE keys SET valid = 1, lastValidated = date('now'), expiresAt = ? WHERE name = ?;");
+
+			codes.assign(users.size(), "");
+
+			std::vector<bool> extended(users.size(), false);
+
+			for (size_t i = 0; i < users.size(); i++) {
+
+				sqlite3_reset(select.get());
+
+				bind(sql, select.get(), 1, users[i]);
+
+				if (!step(sql, select.get()))
+					continue;
+
+				codes[i] = text(select.get(), 0);
+
+				sqlite3_reset(update.get());
+
+				sqlite3_bind_int64(update.get(), 1, expiresAt);
+
+				bind(sql, update.get(), 2, codes[i]);
+
+				step(sql, update.get());
+
+				extended[i] = sqlite3_changes(sql) != 0;
+			}
+
+			return extended;
+
+		}).get();
+	}
+
+	// The expired rows are selected and flipped inside the same write transaction, so the
+	// names returned are exactly the rows that were updated.
+	std::vector<std::string> expire(long long now, size_t limit) override {
+
+		return writes->submit([&](sqlite3* sql) {
+
+			auto select = prepare(sql, "SELECT rowid, name FROM keys WHERE valid = 1 AND expiresAt <= ? LIMIT ?;");
+
+			auto update = prepare(sql, "UPDATE keys SET valid = 0 WHERE rowid = ?;");
+
+			sqlite3_bind_int64(select.get(), 1, now);
+
+			sqlite3_bind_int64(select.get(), 2, static_cast<sqlite3_int64>(limit));
+
+			std::vector<sqlite3_int64> rows;
+
+			std::vector<std::string> names;
+
+			while (step(sql, select.get())) {
+
+				rows.push_back(sqlite3_column_int64(select.get(), 0));
+
+				names.push_back(text(select.get(), 1));
+			}
+
+			for (auto row : rows) {
+
+				sqlite3_reset(update.get());
+
+				sqlite3_bind_int64(update.get(), 1, row);
+
+				step(sql, update.get());
+			}
+
+			return names;
+
+		}).get();
+	}
+
+	// The insert only happens if the name is free and the claim only if the key is unused,
+	// both under one savepoint, so two registrations racing for the same key or name can't
+	// both succeed.
+	std::string claim(const UserRecord& user, long long expiresAt) override {
+
+		return writes->submit([&](sqlite3* sql) {
+
+			execute(sql, "SAVEPOINT claim;");
+
+			try {
+
+				auto insert = prepare(sql, "INSERT INTO users (name, password, code) SELECT ?, ?, ? WHERE NOT EXISTS (SELECT 1 FROM users WHERE name = ?);");
+
+				bind(sql, insert.get(), 1, user.name);
+
+				bind(sql, insert.get(), 2, user.password);
+
+				bind(sql, insert.get(), 3, user.code);
+
+				bind(sql, insert.get(), 4, user.name);
+
+				step(sql, insert.get());
+
+				if (!sqlite3_changes(sql)) {
+
+					execute(sql, "ROLLBACK TO claim; RELEASE claim;");
+
+					return std::string("User already exists");
+				}
+
+				auto claim = prepare(sql, "UPDATE keys SET used = 1, valid = 1, lastValidated = date('now'), expiresAt = ? WHERE name = ? AND used = 0;");
+
+				sqlite3_bind_int64(claim.get(), 1, expiresAt);
+
+				bind(sql, claim.get(), 2, user.code);
+
+				step(sql, claim.get());
+
+				if (!sqlite3_changes(sql)) {
+
+					auto used = prepare(sql, "SELECT used FROM keys WHERE name = ?;");
+
+					bind(sql, used.get(), 1, user.code);
+
+					bool exists = step(sql, used.get());
+
+					execute(sql, "ROLLBACK TO claim; RELEASE claim;");
+
+					return std::string(exists ? "Key already in use" : "Key doesn't exist");
+				}
+
+				execute(sql, "RELEASE claim;");
+			}
+			catch (...) {
+
+				sqlite3_exec(sql, "ROLLBACK TO claim; RELEASE claim;", nullptr, nullptr, nullptr);
+
+				throw;
+			}
+
+			return std::string("User successfully registered");
+
+		}).get();
+	}
+
+	std::string reserveKey(const std::string& code, long long expiresAt, KeyRecord& previous) override {
+
+		return writes->submit([&](sqlite3* sql) {
+
+			auto select = prepare(sql, "SELECT name, used, valid, expiresAt FROM keys WHERE name = ?;");
+
+			bind(sql, select.get(), 1, code);
+
+			if (!step(sql, select.get()))
+				return std::string("Key doesn't exist");
+
+			if (sqlite3_column_int(select.get(), 1))
+				return std::string("Key already in use");
+
+			previous.name		= text(select.get(), 0);
+			previous.valid		= sqlite3_column_int(select.get(), 2) != 0;
+			previous.expiresAt	= sqlite3_column_int64(select.get(), 3);
+
+			auto claim = prepare(sql, "UPDATE keys SET used = 1, valid = 1, lastValidated = date('now'), expiresAt = ? WHERE name = ? AND used = 0;");
+
+			sqlite3_bind_int64(claim.get(), 1, expiresAt);
+
+			bind(sql, claim.get(), 2, code);
+
+			step(sql, claim.get());
+
+			return std::string(sqlite3_changes(sql) ? "" : "Key already in use");
+
+		}).get();
+	}
+
+	void releaseKey(const KeyRecord& previous) override {
+
+		writes->submit([&](sqlite3* sql) {
+
+			auto stmt = prepare(sql, "UPDATE keys SET used = 0, valid = ?, expiresAt = NULLIF(?, 0) WHERE name = ?;");
+
+			sqlite3_bind_int(stmt.get(), 1, previous.valid);
+
+			sqlite3_bind_int64(stmt.get(), 2, previous.expiresAt);
+
+			bind(sql, stmt.get(), 3, previous.name);
+
+			step(sql, stmt.get());
+
+		}).get();
+	}
+
+	bool addUser(const UserRecord& user) override {
+
+		return writes->submit([&](sqlite3* sql) {
+
+			auto insert = prepare(sql, "INSERT INTO users (name, password, code) SELECT ?, ?, ? WHERE NOT EXISTS (SELECT 1 FROM users WHERE name = ?);");
+
+			bind(sql, insert.get(), 1, user.name);
+
+			bind(sql, insert.get(), 2, user.password);
+
+			bind(sql, insert.get(), 3, user.code);
+
+			bind(sql, insert.get(), 4, user.name);
+
+			step(sql, insert.get());
+
+			return sqlite3_changes(sql) != 0;
+
+		}).get();
+	}
+
+public:
+
+	explicit Database(const std::string& databaseName, size_t readerCount = 1) : name{ databaseName } {
+
+		sql = connect(databaseName);
+
+		try {
+
+			createSchema();
+
+			readers.push_back(sql);
+
+			while (readers.size() < readerCount)
+				readers.push_back(connect(databaseName));
+
+			writes = std::make_unique<WriteQueue>(databaseName, 256, std::chrono::milliseconds(2));
+		}
+		catch (...) {
+
+			for (auto connection : readers) {
+
+				if (connection != sql)
+					sqlite3_close_v2(connection);
+			}
+
+			sqlite3_close_v2(sql);
+
+			throw;
+		}
+	}
+
+	~Database() override {
+
+		writes.reset();
+
+		for (auto connection : readers) {
+
+			if (connection != sql)
+				sqlite3_close_v2(connection);
+		}
+
+		sqlite3_close_v2(sql);
+	}
+
+	std::optional<UserRecord> getUser(const std::string& user) override {
+
+		sqlite3* sql = reader();
+
+		auto stmt = prepare(sql, "SELECT name, password, code FROM users WHERE name = ?;");
+
+		bind(sql, stmt.get(), 1, user);
+
+		if (!step(sql, stmt.get()))
+			return {};
+
+		return UserRecord{ text(stmt.get(), 0), text(stmt.get(), 1), text(stmt.get(), 2) };
+	}
+
+	std::optional<KeyRecord> getKey(const std::string& key) override {
+
+		sqlite3* sql = reader();
+
+		auto stmt = prepare(sql, "SELECT name, used, valid, expiresAt, product, channel FROM keys WHERE name = ?;");
+
+		bind(sql, stmt.get(), 1, key);
+
+		if (!step(sql, stmt.get()))
+			return {};
+
+		KeyRecord record;
+
+		record.name			= text(stmt.get(), 0);
+		record.used			= sqlite3_column_int(stmt.get(), 1) != 0;
+		record.valid		= sqlite3_column_int(stmt.get(), 2) != 0;
+		record.expiresAt	= sqlite3_column_int64(stmt.get(), 3);
+		record.product		= text(stmt.get(), 4);
+		record.channel		= text(stmt.get(), 5);
+
+		return record;
+	}
+
+	void listNames(std::vector<std::string>& users, std::vector<std::string>& keys) override {
+
+		auto stmt = prepare(sql, "SELECT name FROM users;");
+
+		while (step(sql, stmt.get()))
+			users.push_back(text(stmt.get(), 0));
+
+		stmt = prepare(sql, "SELECT name FROM keys;");
+
+		while (step(sql, stmt.get()))
+			keys.push_back(text(stmt.get(), 0));
+	}
+
+	std::vector<long long> pendingExpiries() override {
+
+		auto stmt = prepare(sql, "SELECT DISTINCT expiresAt FROM keys WHERE valid = 1 AND expiresAt IS NOT NULL;");
+
+		std::vector<long long> deadlines;
+
+		while (step(sql, stmt.get()))
+			deadlines.push_back(sqlite3_column_int64(stmt.get(), 0));
+
+		return deadlines;
+	}
+
+	void setPassword(const std::string& user, const std::string& password) override {
+
+		writes->submit([&](sqlite3* sql) {
+
+			auto stmt = prepare(sql, "UPDATE users SET password = ? WHERE name = ?;");
+
+			bind(sql, stmt.get(), 1, password);
+
+			bind(sql, stmt.get(), 2, user);
+
+			step(sql, stmt.get());
+
+		}).get();
+	}
+
+	// Each user's key, or an empty string for a missing user, through one prepared statement.
+	std::vector<std::string> userCodes(const std::vector<std::string>& users) {
+
+		sqlite3* sql = reader();
+
+		auto stmt = prepare(sql, "SELECT code FROM users WHERE name = ?;");
+
+		std::vector<std::string> codes;
+
+		for (const auto& user : users) {
+
+			sqlite3_reset(stmt.get());
+
+			bind(sql, stmt.get(), 1, user);
+
+			codes.push_back(step(sql, stmt.get()) ? text(stmt.get(), 0) : "");
+		}
+
+		return codes;
+	}
+};
@@ -0,0 +1,174 @@
+#include "Delta.h"
+#include <unordered_map>
+#include <cstring>
+
+namespace {
+
+	constexpr size_t	blockSize	= 32;
+	constexpr uint64_t	prime		= 0x100000001B3ULL;
+
+	uint64_t hashBlock(const unsigned char* data) {
+
+		uint64_t hash = 0;
+
+		for (size_t i = 0; i < blockSize; i++)
+			hash = hash * prime + data[i];
+
+		return hash;
+	}
+
+	void putNumber(std::vector<char>& delta, uint64_t number) {
+
+		const char* bytes = reinterpret_cast<const char*>(&number);
+
+		delta.insert(delta.end(), bytes, bytes + sizeof(number));
+	}
+
+	bool getNumber(const std::vector<char>& delta, size_t& position, uint64_t& number) {
+
+		if (delta.size() - position < sizeof(number))
+			return false;
+
+		std::memcpy(&number, delta.data() + position, sizeof(number));
+
+		position += sizeof(number);
+
+		return true;
+	}
+
+	void putInsert(std::vector<char>& delta, const char* target, size_t begin, size_t end) {
+
+		if (begin == end)
+			return;
+
+		delta.push_back(DELTA_INSERT);
+
+		putNumber(delta, end - begin);
+
+		delta.insert(delta.end(), target + begin, target + end);
+	}
+
+	void putCopy(std::vector<char>& delta, size_t offset, size_t length) {
+
+		delta.push_back(DELTA_COPY);
+
+		putNumber(delta, offset);
+
+		putNumber(delta, length);
+	}
+}
+
+std::vector<char> makeDelta(const char* base, size_t baseSize, const char* target, size_t targetSize) {
+
+	std::vector<char> delta;
+
+	auto baseBytes		= reinterpret_cast<const unsigned char*>(base);
+	auto targetBytes	= reinterpret_cast<const unsigned char*>(target);
+
+	if (baseSize < blockSize || targetSize < blockSize) {
+
+		putInsert(delta, target, 0, targetSize);
+
+		return delta;
+	}
+
+	std::unordered_map<uint64_t, size_t> blocks;
+
+	blocks.reserve(baseSize / blockSize);
+
+	for (size_t offset = 0; offset + blockSize <= baseSize; offset += blockSize)
+		blocks.emplace(hashBlock(baseBytes + offset), offset);
+
+	uint64_t outFactor = 1;
+
+	for (size_t i = 1; i < blockSize; i++)
+		outFactor *= prime;
+
+	size_t pending	= 0;
+	size_t position	= 0;
+
+	uint64_t hash = hashBlock(targetBytes);
+
+	while (position + blockSize <= targetSize) {
+
+		auto match = blocks.find(hash);
+
+		if (match != blocks.end() && !std::memcmp(baseBytes + match->second, targetBytes + position, blockSize)) {
+
+			size_t baseBegin	= match->second;
+			size_t targetBegin	= position;
+
+			while (baseBegin > 0 && targetBegin > pending && baseBytes[baseBegin - 1] == targetBytes[targetBegin - 1]) {
+
+				baseBegin--;
+
+				targetBegin--;
+			}
+
+			size_t length = position - targetBegin + blockSize;
+
+			while (baseBegin + length < baseSize && targetBegin + length < targetSize && baseBytes[baseBegin + length] == targetBytes[targetBegin + length])
+				length++;
+
+			putInsert(delta, target, pending, targetBegin);
+
+			putCopy(delta, baseBegin, length);
+
+			pending = position = targetBegin + length;
+
+			if (position + blockSize <= targetSize)
+				hash = hashBlock(targetBytes + position);
+
+			continue;
+		}
+
+		if (position + blockSize < targetSize)
+			hash = (hash - targetBytes[position] * outFactor) * prime + targetBytes[position + blockSize];
+
+		position++;
+	}
+
+	putInsert(delta, target, pending, targetSize);
+
+	return delta;
+}
+
+bool applyDelta(const char* base, size_t baseSize, const std::vector<char>& delta, std::vector<char>& target) {
+
+	target.clear();
+
+	size_t position = 0;
+
+	while (position < delta.size()) {
+
+		char opcode = delta[position++];
+
+		uint64_t first{}, second{};
+
+		if (!getNumber(delta, position, first))
+			return false;
+
+		if (opcode == DELTA_COPY) {
+
+			if (!getNumber(delta, position, second) || first > baseSize || second > baseSize - first)
+				return false;
+
+			target.insert(target.end(), base + first, base + first + second);
+		}
+		else if (opcode == DELTA_INSERT) {
+
+			if (first > delta.size() - position)
+				return false;
+
+			target.insert(target.end(), delta.begin() + position, delta.begin() + position + first);
+
+			position += first;
+		}
+		else {
+
+			return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Patch format: a sequence of operations, each starting with a one byte opcode.
+//   DELTA_COPY   ULONGLONG offset, ULONGLONG length   - copy length bytes from the base at offset
+//   DELTA_INSERT ULONGLONG length, length bytes       - append the literal bytes
+// Applying every operation in order to the base reproduces the target.
+
+#define DELTA_COPY		0x1
+#define DELTA_INSERT	0x2
+
+std::vector<char> makeDelta(const char* base, size_t baseSize, const char* target, size_t targetSize);
+
+bool applyDelta(const char* base, size_t baseSize, const std::vector<char>& delta, std::vector<char>& target);
@@ -0,0 +1,90 @@
+#include "ExpiryScheduler.h"
+#include <chrono>
+#include <ctime>
+#include <iostream>
+
+ExpiryScheduler::ExpiryScheduler(std::function<void(long long)> expire, const std::vector<long long>& pending) :
+	expire{ std::move(expire) }, deadlines{ std::greater<long long>{}, pending } {
+
+	worker = std::thread{ &ExpiryScheduler::run, this };
+}
+
+ExpiryScheduler::~ExpiryScheduler() {
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		running = false;
+	}
+
+	changed.notify_all();
+
+	if (worker.joinable())
+		worker.join();
+}
+
+void ExpiryScheduler::schedule(long long deadline) {
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		deadlines.push(deadline);
+	}
+
+	changed.notify_all();
+}
+
+size_t ExpiryScheduler::size() {
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	return deadlines.size();
+}
+
+void ExpiryScheduler::run() {
+
+	std::unique_lock<std::mutex> lock{ mutex };
+
+	while (running) {
+
+		if (deadlines.empty()) {
+
+			changed.wait(lock);
+
+			continue;
+		}
+
+		long long now = std::time(nullptr);
+
+		if (deadlines.top() > now) {
+
+			changed.wait_until(lock, std::chrono::system_clock::from_time_t(deadlines.top()));
+
+			continue;
+		}
+
+		// Everything already due is handled by a single range update, so equal or older
+		// deadlines are dropped together.
+		while (!deadlines.empty() && deadlines.top() <= now)
+			deadlines.pop();
+
+		lock.unlock();
+
+		try {
+
+			expire(now);
+		}
+		catch (std::exception& ex) {
+
+			std::cerr << "Expiry scheduler exception: " << ex.what() << std::endl;
+
+			lock.lock();
+
+			deadlines.push(now + 60);
+
+			continue;
+		}
+
+		lock.lock();
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+// Wakes up exactly when the earliest known key deadline passes. Deadlines are unix seconds
+// kept in a min-heap; on each wakeup the expire callback is handed the current time and is
+// expected to invalidate every key whose indexed deadline is not later than that.
+class ExpiryScheduler
+{
+	std::function<void(long long)>												expire;
+
+	std::mutex																	mutex;
+	std::condition_variable														changed;
+	std::priority_queue<long long, std::vector<long long>, std::greater<long long>>	deadlines;
+	bool																		running = true;
+	std::thread																	worker;
+
+	void run();
+
+public:
+
+	ExpiryScheduler(std::function<void(long long)> expire, const std::vector<long long>& pending);
+
+	~ExpiryScheduler();
+
+	ExpiryScheduler(const ExpiryScheduler& other)				= delete;
+
+	ExpiryScheduler& operator=(const ExpiryScheduler& other)	= delete;
+
+	void schedule(long long deadline);
+
+	size_t size();
+};
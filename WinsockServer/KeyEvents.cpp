@@ -0,0 +1,29 @@
+#include "KeyEvents.h"
+
+void KeyEventBus::subscribe(Handler handler) {
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	handlers.push_back(std::move(handler));
+}
+
+void KeyEventBus::publish(KeyEvent event, const std::string& key) {
+
+	std::vector<Handler> current;
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		current = handlers;
+	}
+
+	for (const auto& handler : current)
+		handler(event, key);
+}
+
+KeyEventBus& keyEvents() {
+
+	static KeyEventBus events;
+
+	return events;
+}
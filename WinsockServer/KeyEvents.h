@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <mutex>
+
+enum class KeyEvent { Added, Validated, Invalidated };
+
+// Carries key state changes from wherever they happen to whoever cares about them. Events
+// are published after the change is committed and delivered synchronously on the
+// publishing thread.
+class KeyEventBus
+{
+	using Handler = std::function<void(KeyEvent, const std::string&)>;
+
+	std::mutex				mutex;
+	std::vector<Handler>	handlers;
+
+public:
+
+	KeyEventBus() = default;
+
+	KeyEventBus(const KeyEventBus& other)				= delete;
+
+	KeyEventBus& operator=(const KeyEventBus& other)	= delete;
+
+	void subscribe(Handler handler);
+
+	void publish(KeyEvent event, const std::string& key);
+};
+
+KeyEventBus& keyEvents();
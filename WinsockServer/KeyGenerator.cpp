@@ -0,0 +1,45 @@
+#include "KeyGenerator.h"
+#include <stdexcept>
+#include <bitset>
+
+KeyGenerator::KeyGenerator(const std::string& alphabet, size_t length) :
+	alphabet{ alphabet }, length{ length }, limit{ 256 - 256 % static_cast<unsigned>(alphabet.size() ? alphabet.size() : 1) } {
+
+	if (!isValidAlphabet(alphabet))
+		throw std::runtime_error("Key alphabet must have at least 2 distinct printable characters and no whitespace");
+}
+
+bool KeyGenerator::isValidAlphabet(const std::string& alphabet) {
+
+	if (alphabet.size() < 2)
+		return false;
+
+	std::bitset<256> seen;
+
+	for (unsigned char c : alphabet) {
+
+		if (c <= ' ' || c >= 0x7F || seen[c])
+			return false;
+
+		seen[c] = true;
+	}
+
+	return true;
+}
+
+std::string KeyGenerator::next() {
+
+	std::string key;
+
+	key.reserve(length);
+
+	while (key.length() < length) {
+
+		unsigned value = random.next();
+
+		if (value < limit)
+			key.push_back(alphabet[value % alphabet.size()]);
+	}
+
+	return key;
+}
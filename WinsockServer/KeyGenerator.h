@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include "ChaCha20.h"
+
+// Produces random keys of a fixed length over an alphabet. Bytes that would bias the
+// distribution towards the start of the alphabet are rejected.
+class KeyGenerator
+{
+	ChaCha20		random;
+	std::string		alphabet;
+	size_t			length;
+	unsigned		limit;
+
+public:
+
+	static constexpr const char* defaultAlphabet = "ABCDEFGHJKLMNPQRSTUVWXYZ23456789";
+
+	// At least two distinct printable ASCII characters and no whitespace, so keys stay one per
+	// line and every character is drawn equally often.
+	static bool isValidAlphabet(const std::string& alphabet);
+
+	KeyGenerator(const std::string& alphabet, size_t length);
+
+	KeyGenerator(const KeyGenerator& other)				= delete;
+
+	KeyGenerator& operator=(const KeyGenerator& other)	= delete;
+
+	std::string next();
+};
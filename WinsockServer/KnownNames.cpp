@@ -0,0 +1,157 @@
+#include "KnownNames.h"
+#include <stdexcept>
+#include <thread>
+#include <iostream>
+
+KnownNames::KnownNames(double falsePositiveRate) : falsePositiveRate{ falsePositiveRate } {}
+
+std::shared_ptr<BloomFilter> KnownNames::build(const std::vector<std::string>& names) {
+
+	// Leave room to grow so the false positive rate holds until the next rebuild.
+	auto filter = std::make_shared<BloomFilter>(std::max<size_t>(names.size() * 2, 1024), falsePositiveRate);
+
+	for (const auto& name : names)
+		filter->add(name);
+
+	return filter;
+}
+
+void KnownNames::rebuild(Storage& storage) {
+
+	std::lock_guard<std::mutex> rebuildLock{ rebuildMutex };
+
+	{
+		std::lock_guard<std::mutex> lock{ pendingMutex };
+
+		rebuilding	= true;
+		source		= &storage;
+	}
+
+	std::shared_ptr<BloomFilter> newUsers, newKeys;
+
+	try {
+
+		std::vector<std::string> userNames, keyNames;
+
+		storage.listNames(userNames, keyNames);
+
+		newUsers	= build(userNames);
+		newKeys		= build(keyNames);
+	}
+	catch (...) {
+
+		std::lock_guard<std::mutex> lock{ pendingMutex };
+
+		rebuilding = false;
+
+		pendingUsers.clear();
+
+		pendingKeys.clear();
+
+		throw;
+	}
+
+	std::lock_guard<std::mutex> lock{ pendingMutex };
+
+	for (const auto& name : pendingUsers)
+		newUsers->add(name);
+
+	for (const auto& name : pendingKeys)
+		newKeys->add(name);
+
+	pendingUsers.clear();
+
+	pendingKeys.clear();
+
+	std::atomic_store(&users, newUsers);
+
+	std::atomic_store(&keys, newKeys);
+
+	rebuilding = false;
+}
+
+void KnownNames::addUser(const std::string& name) {
+
+	std::lock_guard<std::mutex> lock{ pendingMutex };
+
+	auto filter = std::atomic_load(&users);
+
+	if (filter)
+		filter->add(name);
+
+	if (rebuilding)
+		pendingUsers.push_back(name);
+	else
+		regrowIfSaturated(filter);
+}
+
+void KnownNames::addKey(const std::string& name) {
+
+	std::lock_guard<std::mutex> lock{ pendingMutex };
+
+	auto filter = std::atomic_load(&keys);
+
+	if (filter)
+		filter->add(name);
+
+	if (rebuilding)
+		pendingKeys.push_back(name);
+	else
+		regrowIfSaturated(filter);
+}
+
+// Called with pendingMutex held, so the rebuild itself runs on its own thread.
+void KnownNames::regrowIfSaturated(const std::shared_ptr<BloomFilter>& filter) {
+
+	if (!filter || !filter->isSaturated() || !source || regrowing.exchange(true))
+		return;
+
+	Storage* storage = source;
+
+	std::thread{ [this, storage] {
+
+		try {
+
+			rebuild(*storage);
+		}
+		catch (std::exception& ex) {
+
+			std::cerr << "Name filter rebuild exception: " << ex.what() << std::endl;
+		}
+
+		regrowing = false;
+
+	} }.detach();
+}
+
+bool KnownNames::mightContain(const std::shared_ptr<BloomFilter>& filter, const std::string& name) const {
+
+	return !filter || filter->mightContain(name);
+}
+
+bool KnownNames::mightHaveUser(const std::string& name) {
+
+	if (mightContain(std::atomic_load(&users), name))
+		return true;
+
+	rejectedUsers++;
+
+	return false;
+}
+
+bool KnownNames::mightHaveKey(const std::string& name) {
+
+	if (mightContain(std::atomic_load(&keys), name))
+		return true;
+
+	rejectedKeys++;
+
+	return false;
+}
+
+KnownNames& knownNames() {
+
+	static KnownNames names{ 0.01 };
+
+	return names;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <atomic>
+#include "Storage.h"
+#include "BloomFilter.h"
+#include "Metrics.h"
+
+// In-memory Bloom filters over every user name and key name, so lookups for names that
+// definitely don't exist never reach the database. Until the first rebuild every name is
+// reported as possibly present. Once names added since the last rebuild push a filter past
+// its capacity, both are rebuilt from storage in the background at twice the size.
+class KnownNames
+{
+	double							falsePositiveRate;
+
+	std::shared_ptr<BloomFilter>	users;
+	std::shared_ptr<BloomFilter>	keys;
+
+	std::mutex						rebuildMutex;
+	std::mutex						pendingMutex;
+	bool							rebuilding = false;
+	Storage*						source = nullptr;
+	std::atomic<bool>				regrowing{ false };
+	std::vector<std::string>		pendingUsers;
+	std::vector<std::string>		pendingKeys;
+
+	std::atomic<long long>&			rejectedUsers	= metrics.get("filter.rejected_users");
+	std::atomic<long long>&			rejectedKeys	= metrics.get("filter.rejected_keys");
+
+	std::shared_ptr<BloomFilter> build(const std::vector<std::string>& names);
+
+	bool mightContain(const std::shared_ptr<BloomFilter>& filter, const std::string& name) const;
+
+	void regrowIfSaturated(const std::shared_ptr<BloomFilter>& filter);
+
+public:
+
+	explicit KnownNames(double falsePositiveRate);
+
+	KnownNames(const KnownNames& other)				= delete;
+
+	KnownNames& operator=(const KnownNames& other)	= delete;
+
+	void rebuild(Storage& storage);
+
+	void addUser(const std::string& name);
+
+	void addKey(const std::string& name);
+
+	bool mightHaveUser(const std::string& name);
+
+	bool mightHaveKey(const std::string& name);
+};
+
+KnownNames& knownNames();
@@ -0,0 +1,794 @@
+#include "MemoryStorage.h"
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+
+	void writeInteger(std::string& out, uint64_t value, size_t size) {
+
+		for (size_t i = 0; i < size; i++)
+			out.push_back(static_cast<char>(value >> (i * 8)));
+	}
+
+	void writeString(std::string& out, const std::string& value) {
+
+		writeInteger(out, value.size(), 4);
+
+		out += value;
+	}
+
+	// Frame lengths are stored in 4 bytes.
+	constexpr size_t maxFrame = 0xFFFFFFFF;
+
+	// Snapshots are split into frames of about this size, so they never reach maxFrame.
+	constexpr size_t snapshotFrame = 64 * 1024 * 1024;
+
+	void writeFrame(std::string& out, const std::string& batch) {
+
+		writeInteger(out, batch.size(), 4);
+
+		out += batch;
+	}
+
+	// WriteFile takes a 32 bit length, so large buffers go out in blocks.
+	bool writeFully(HANDLE file, const char* data, size_t size) {
+
+		while (size) {
+
+			DWORD block = static_cast<DWORD>(size > 0x40000000 ? 0x40000000 : size);
+
+			DWORD written = 0;
+
+			if (!WriteFile(file, data, block, &written, nullptr) || written == 0)
+				return false;
+
+			data += written;
+
+			size -= written;
+		}
+
+		return true;
+	}
+
+	class Reader {
+
+		const std::string&	data;
+		size_t				position = 0;
+
+	public:
+
+		explicit Reader(const std::string& data) : data{ data } {}
+
+		bool done() const {
+
+			return position == data.size();
+		}
+
+		uint64_t integer(size_t size) {
+
+			if (data.size() - position < size)
+				throw std::runtime_error("Truncated log record");
+
+			uint64_t value = 0;
+
+			for (size_t i = 0; i < size; i++)
+				value |= static_cast<uint64_t>(static_cast<unsigned char>(data[position + i])) << (i * 8);
+
+			position += size;
+
+			return value;
+		}
+
+		std::string string() {
+
+			size_t size = static_cast<size_t>(integer(4));
+
+			if (data.size() - position < size)
+				throw std::runtime_error("Truncated log record");
+
+			std::string value = data.substr(position, size);
+
+			position += size;
+
+			return value;
+		}
+	};
+}
+
+MemoryStorage::MemoryStorage(const std::string& path) : path{ path } {
+
+	openLog(replay());
+
+	compactor = std::thread{ &MemoryStorage::compactPeriodically, this };
+}
+
+MemoryStorage::~MemoryStorage() {
+
+	running = false;
+
+	if (compactor.joinable())
+		compactor.join();
+
+	CloseHandle(log);
+}
+
+void MemoryStorage::encode(std::string& batch, const UserRecord& user) {
+
+	batch.push_back('U');
+
+	writeString(batch, user.name);
+	writeString(batch, user.password);
+	writeString(batch, user.code);
+}
+
+void MemoryStorage::encode(std::string& batch, const KeyRecord& key) {
+
+	batch.push_back('K');
+
+	writeString(batch, key.name);
+	writeInteger(batch, key.used, 1);
+	writeInteger(batch, key.valid, 1);
+	writeInteger(batch, static_cast<uint64_t>(key.expiresAt), 8);
+	writeString(batch, key.product);
+	writeString(batch, key.channel);
+}
+
+// Batches are framed with their length, so a batch cut short by a crash is dropped whole.
+// Returns the length of the log up to the end of the last complete batch.
+uint64_t MemoryStorage::replay() {
+
+	std::ifstream ifile{ path, std::ios::binary };
+
+	if (!ifile)
+		return 0;
+
+	uint64_t complete = 0;
+
+	std::string frame;
+
+	char length[4];
+
+	while (ifile.read(length, sizeof(length))) {
+
+		uint32_t size = 0;
+
+		for (size_t i = 0; i < sizeof(length); i++)
+			size |= static_cast<uint32_t>(static_cast<unsigned char>(length[i])) << (i * 8);
+
+		frame.resize(size);
+
+		if (!ifile.read(&frame[0], size))
+			break;
+
+		Reader reader{ frame };
+
+		while (!reader.done()) {
+
+			char type = static_cast<char>(reader.integer(1));
+
+			if (type == 'U') {
+
+				UserRecord user;
+
+				user.name		= reader.string();
+				user.password	= reader.string();
+				user.code		= reader.string();
+
+				*users.insert(user.name).first = user;
+			}
+			else if (type == 'K') {
+
+				KeyRecord key;
+
+				key.name		= reader.string();
+				key.used		= reader.integer(1) != 0;
+				key.valid		= reader.integer(1) != 0;
+				key.expiresAt	= static_cast<long long>(reader.integer(8));
+				key.product		= reader.string();
+				key.channel		= reader.string();
+
+				auto slot = keys.insert(key.name).first;
+
+				long long expiresAt = key.expiresAt;
+
+				key.expiresAt = slot->expiresAt;
+
+				*slot = key;
+
+				setExpiry(*slot, expiresAt);
+			}
+			else {
+
+				throw std::runtime_error("Unknown record in " + path);
+			}
+
+			logRecords++;
+		}
+
+		complete += sizeof(length) + size;
+	}
+
+	return complete;
+}
+
+// Anything past length is a batch torn by a crash; it is cut off so new batches follow the
+// last complete one.
+void MemoryStorage::openLog(uint64_t length) {
+
+	log = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (log == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("CreateFileA failed with code " + std::to_string(GetLastError()));
+
+	try {
+
+		truncateLog(length);
+	}
+	catch (...) {
+
+		CloseHandle(log);
+
+		log = INVALID_HANDLE_VALUE;
+
+		throw;
+	}
+}
+
+void MemoryStorage::truncateLog(uint64_t length) {
+
+	LARGE_INTEGER position{};
+
+	position.QuadPart = static_cast<long long>(length);
+
+	if (!SetFilePointerEx(log, position, nullptr, FILE_BEGIN) || !SetEndOfFile(log))
+		throw std::runtime_error("Failed to truncate " + path + " with code " + std::to_string(GetLastError()));
+
+	logLength = length;
+}
+
+// Called with the table lock held and before the batch is applied, so batches reach the file
+// in the order they are applied and a batch that can't be logged is never applied. A write
+// that fails part way is cut off again so the log stays a sequence of complete batches.
+void MemoryStorage::append(const std::string& batch, size_t records) {
+
+	if (batch.empty())
+		return;
+
+	if (batch.size() > maxFrame)
+		throw std::runtime_error("Batch of " + std::to_string(batch.size()) + " bytes is too large to log");
+
+	std::string frame;
+
+	writeFrame(frame, batch);
+
+	if (!writeFully(log, frame.data(), frame.size())) {
+
+		DWORD error = GetLastError();
+
+		truncateLog(logLength);
+
+		throw std::runtime_error("WriteFile failed with code " + std::to_string(error));
+	}
+
+	logLength	+= frame.size();
+	logRecords	+= records;
+}
+
+// Called after the table lock is released, so one flush can cover batches appended by
+// several writers.
+void MemoryStorage::flush() {
+
+	std::lock_guard<std::mutex> lock{ logMutex };
+
+	if (!FlushFileBuffers(log))
+		throw std::runtime_error("FlushFileBuffers failed with code " + std::to_string(GetLastError()));
+}
+
+void MemoryStorage::setExpiry(KeyRecord& key, long long expiresAt) {
+
+	if (key.expiresAt) {
+
+		auto range = expiries.equal_range(key.expiresAt);
+
+		for (auto entry = range.first; entry != range.second; entry++) {
+
+			if (entry->second == key.name) {
+
+				expiries.erase(entry);
+
+				break;
+			}
+		}
+	}
+
+	key.expiresAt = expiresAt;
+
+	if (expiresAt && key.valid)
+		expiries.emplace(expiresAt, key.name);
+}
+
+// The snapshot is encoded under the shared lock and written and flushed without any lock, so
+// lookups never wait on it. Batches logged meanwhile are copied over from the old log under
+// the exclusive lock, which is only held for that short tail and the swap.
+void MemoryStorage::compact() {
+
+	std::string frames, batch;
+
+	uint64_t snapshotLength;
+
+	size_t snapshotRecords, liveRecords;
+
+	auto closeFrame = [&](size_t threshold) {
+
+		if (batch.size() < threshold || batch.empty())
+			return;
+
+		writeFrame(frames, batch);
+
+		batch.clear();
+	};
+
+	{
+		std::shared_lock<std::shared_mutex> lock{ mutex };
+
+		users.forEach([&](const std::string&, const UserRecord& user) { encode(batch, user); closeFrame(snapshotFrame); });
+
+		keys.forEach([&](const std::string&, const KeyRecord& key) { encode(batch, key); closeFrame(snapshotFrame); });
+
+		closeFrame(0);
+
+		snapshotLength	= logLength;
+		snapshotRecords	= logRecords;
+		liveRecords		= users.size() + keys.size();
+	}
+
+	std::string temporaryPath = path + ".tmp";
+
+	HANDLE file = CreateFileA(temporaryPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("CreateFileA failed with code " + std::to_string(GetLastError()));
+
+	if (!writeFully(file, frames.data(), frames.size()) || !FlushFileBuffers(file)) {
+
+		CloseHandle(file);
+
+		throw std::runtime_error("Failed to write " + temporaryPath);
+	}
+
+	std::unique_lock<std::shared_mutex> lock{ mutex };
+
+	std::lock_guard<std::mutex> flushLock{ logMutex };
+
+	std::string tail(static_cast<size_t>(logLength - snapshotLength), '\0');
+
+	std::ifstream ifile{ path, std::ios::binary };
+
+	bool complete = ifile.seekg(static_cast<std::streamoff>(snapshotLength)) && ifile.read(&tail[0], static_cast<std::streamsize>(tail.size())) && writeFully(file, tail.data(), tail.size()) && FlushFileBuffers(file);
+
+	ifile.close();
+
+	CloseHandle(file);
+
+	if (!complete)
+		throw std::runtime_error("Failed to write " + temporaryPath);
+
+	CloseHandle(log);
+
+	log = INVALID_HANDLE_VALUE;
+
+	if (!MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+
+		DWORD error = GetLastError();
+
+		openLog(logLength);
+
+		throw std::runtime_error("MoveFileExA failed with code " + std::to_string(error));
+	}
+
+	openLog(frames.size() + tail.size());
+
+	logRecords = liveRecords + (logRecords - snapshotRecords);
+}
+
+void MemoryStorage::compactPeriodically() {
+
+	while (running) {
+
+		for (int i = 0; i < 60 && running; i++)
+			Sleep(1000);
+
+		size_t live, logged;
+
+		{
+			std::shared_lock<std::shared_mutex> lock{ mutex };
+
+			live	= users.size() + keys.size();
+			logged	= logRecords;
+		}
+
+		if (logged <= live * 2 + 1024)
+			continue;
+
+		try {
+
+			compact();
+		}
+		catch (std::exception& ex) {
+
+			std::cerr << "Log compaction exception: " << ex.what() << std::endl;
+		}
+	}
+}
+
+std::optional<UserRecord> MemoryStorage::getUser(const std::string& name) {
+
+	std::shared_lock<std::shared_mutex> lock{ mutex };
+
+	auto user = users.get(name);
+
+	if (!user)
+		return {};
+
+	return *user;
+}
+
+std::optional<KeyRecord> MemoryStorage::getKey(const std::string& name) {
+
+	std::shared_lock<std::shared_mutex> lock{ mutex };
+
+	auto key = keys.get(name);
+
+	if (!key)
+		return {};
+
+	return *key;
+}
+
+void MemoryStorage::listNames(std::vector<std::string>& userNames, std::vector<std::string>& keyNames) {
+
+	std::shared_lock<std::shared_mutex> lock{ mutex };
+
+	users.forEach([&](const std::string& name, const UserRecord&) { userNames.push_back(name); });
+
+	keys.forEach([&](const std::string& name, const KeyRecord&) { keyNames.push_back(name); });
+}
+
+std::vector<long long> MemoryStorage::pendingExpiries() {
+
+	std::shared_lock<std::shared_mutex> lock{ mutex };
+
+	std::vector<long long> deadlines;
+
+	for (auto entry = expiries.begin(); entry != expiries.end(); entry = expiries.upper_bound(entry->first))
+		deadlines.push_back(entry->first);
+
+	return deadlines;
+}
+
+void MemoryStorage::setPassword(const std::string& name, const std::string& password) {
+
+	{
+		std::unique_lock<std::shared_mutex> lock{ mutex };
+
+		auto user = users.get(name);
+
+		if (!user)
+			return;
+
+		UserRecord updated = *user;
+
+		updated.password = password;
+
+		std::string batch;
+
+		encode(batch, updated);
+
+		append(batch, 1);
+
+		*user = updated;
+	}
+
+	flush();
+}
+
+std::string MemoryStorage::claim(const UserRecord& user, long long expiresAt) {
+
+	{
+		std::unique_lock<std::shared_mutex> lock{ mutex };
+
+		if (users.get(user.name))
+			return std::string("User already exists");
+
+		auto key = keys.get(user.code);
+
+		if (!key)
+			return std::string("Key doesn't exist");
+
+		if (key->used)
+			return std::string("Key already in use");
+
+		KeyRecord claimed = *key;
+
+		claimed.used		= true;
+		claimed.valid		= true;
+		claimed.expiresAt	= expiresAt;
+
+		std::string batch;
+
+		encode(batch, user);
+
+		encode(batch, claimed);
+
+		append(batch, 2);
+
+		key->used	= true;
+		key->valid	= true;
+
+		setExpiry(*key, expiresAt);
+
+		*users.insert(user.name).first = user;
+	}
+
+	flush();
+
+	return std::string("User successfully registered");
+}
+
+std::string MemoryStorage::reserveKey(const std::string& code, long long expiresAt, KeyRecord& previous) {
+
+	{
+		std::unique_lock<std::shared_mutex> lock{ mutex };
+
+		auto key = keys.get(code);
+
+		if (!key)
+			return std::string("Key doesn't exist");
+
+		if (key->used)
+			return std::string("Key already in use");
+
+		previous = *key;
+
+		KeyRecord claimed = *key;
+
+		claimed.used		= true;
+		claimed.valid		= true;
+		claimed.expiresAt	= expiresAt;
+
+		std::string batch;
+
+		encode(batch, claimed);
+
+		append(batch, 1);
+
+		key->used	= true;
+		key->valid	= true;
+
+		setExpiry(*key, expiresAt);
+	}
+
+	flush();
+
+	return std::string();
+}
+
+void MemoryStorage::releaseKey(const KeyRecord& previous) {
+
+	{
+		std::unique_lock<std::shared_mutex> lock{ mutex };
+
+		auto key = keys.get(previous.name);
+
+		if (!key)
+			return;
+
+		KeyRecord released = *key;
+
+		released.used		= false;
+		released.valid		= previous.valid;
+		released.expiresAt	= previous.expiresAt;
+
+		std::string batch;
+
+		encode(batch, released);
+
+		append(batch, 1);
+
+		key->used	= false;
+		key->valid	= previous.valid;
+
+		setExpiry(*key, previous.expiresAt);
+	}
+
+	flush();
+}
+
+bool MemoryStorage::addUser(const UserRecord& user) {
+
+	{
+		std::unique_lock<std::shared_mutex> lock{ mutex };
+
+		if (users.get(user.name))
+			return false;
+
+		std::string batch;
+
+		encode(batch, user);
+
+		append(batch, 1);
+
+		*users.insert(user.name).first = user;
+	}
+
+	flush();
+
+	return true;
+}
+
+std::vector<bool> MemoryStorage::insertKeys(const std::vector<std::string>& names) {
+
+	std::vector<bool> added;
+
+	{
+		std::unique_lock<std::shared_mutex> lock{ mutex };
+
+		std::string batch;
+
+		std::unordered_set<std::string> fresh;
+
+		for (const auto& name : names) {
+
+			bool inserted = !keys.get(name) && fresh.insert(name).second;
+
+			added.push_back(inserted);
+
+			if (!inserted)
+				continue;
+
+			KeyRecord key;
+
+			key.name = name;
+
+			encode(batch, key);
+		}
+
+		append(batch, fresh.size());
+
+		for (const auto& name : fresh)
+			keys.insert(name).first->name = name;
+	}
+
+	flush();
+
+	return added;
+}
+
+// Called with the unique lock held; the caller flushes once it has been released.
+std::vector<bool> MemoryStorage::applyExtensions(const std::vector<std::string>& names, long long expiresAt) {
+
+	std::vector<bool> extended;
+
+	std::string batch;
+
+	std::vector<KeyRecord*> found;
+
+	for (const auto& name : names) {
+
+		auto key = name.empty() ? nullptr : keys.get(name);
+
+		extended.push_back(key != nullptr);
+
+		if (!key)
+			continue;
+
+		KeyRecord updated = *key;
+
+		updated.valid		= true;
+		updated.expiresAt	= expiresAt;
+
+		encode(batch, updated);
+
+		found.push_back(key);
+	}
+
+	append(batch, found.size());
+
+	for (auto key : found) {
+
+		key->valid = true;
+
+		setExpiry(*key, expiresAt);
+	}
+
+	return extended;
+}
+
+std::vector<bool> MemoryStorage::extendKeys(const std::vector<std::string>& names, long long expiresAt) {
+
+	std::vector<bool> extended;
+
+	{
+		std::unique_lock<std::shared_mutex> lock{ mutex };
+
+		extended = applyExtensions(names, expiresAt);
+	}
+
+	flush();
+
+	return extended;
+}
+
+std::vector<bool> MemoryStorage::extendUserKeys(const std::vector<std::string>& names, long long expiresAt, std::vector<std::string>& codes) {
+
+	std::vector<bool> extended;
+
+	{
+		std::unique_lock<std::shared_mutex> lock{ mutex };
+
+		codes.clear();
+
+		for (const auto& name : names) {
+
+			auto user = users.get(name);
+
+			codes.push_back(user ? user->code : "");
+		}
+
+		extended = applyExtensions(codes, expiresAt);
+	}
+
+	flush();
+
+	return extended;
+}
+
+std::vector<std::string> MemoryStorage::expire(long long now, size_t limit) {
+
+	std::vector<std::string> names;
+
+	{
+		std::unique_lock<std::shared_mutex> lock{ mutex };
+
+		std::string batch;
+
+		std::vector<KeyRecord*> expired;
+
+		auto entry = expiries.begin();
+
+		for (; entry != expiries.end() && entry->first <= now && expired.size() < limit; entry++) {
+
+			auto key = keys.get(entry->second);
+
+			if (!key || !key->valid)
+				continue;
+
+			KeyRecord updated = *key;
+
+			updated.valid = false;
+
+			encode(batch, updated);
+
+			expired.push_back(key);
+		}
+
+		append(batch, expired.size());
+
+		expiries.erase(expiries.begin(), entry);
+
+		for (auto key : expired) {
+
+			key->valid = false;
+
+			names.push_back(key->name);
+		}
+	}
+
+	flush();
+
+	return names;
+}
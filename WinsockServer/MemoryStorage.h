@@ -0,0 +1,90 @@
+#pragma once
+
+#include <Windows.h>
+#include <string>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
+#include "Storage.h"
+#include "OpenHashMap.h"
+
+// In-memory backend. Users and keys live in open addressing hash tables; every change is
+// appended to a log as a framed batch of full records before it is applied, and flushed
+// before the call returns. The log is replayed on startup, cut back to its last complete
+// batch, and rewritten as a snapshot once it has grown to more than twice the live record
+// count.
+class MemoryStorage : public Storage
+{
+	std::string								path;
+	HANDLE									log				= INVALID_HANDLE_VALUE;
+	uint64_t								logLength		= 0;
+	size_t									logRecords		= 0;
+
+	std::shared_mutex						mutex;
+	std::mutex								logMutex;
+	OpenHashMap<UserRecord>					users;
+	OpenHashMap<KeyRecord>					keys;
+	std::multimap<long long, std::string>	expiries;
+
+	std::atomic<bool>						running{ true };
+	std::thread								compactor;
+
+	static void encode(std::string& batch, const UserRecord& user);
+
+	static void encode(std::string& batch, const KeyRecord& key);
+
+	uint64_t replay();
+
+	void openLog(uint64_t length);
+
+	void truncateLog(uint64_t length);
+
+	void append(const std::string& batch, size_t records);
+
+	void flush();
+
+	void setExpiry(KeyRecord& key, long long expiresAt);
+
+	std::vector<bool> applyExtensions(const std::vector<std::string>& names, long long expiresAt);
+
+	void compact();
+
+	void compactPeriodically();
+
+protected:
+
+	std::vector<bool> insertKeys(const std::vector<std::string>& names) override;
+
+	std::vector<bool> extendKeys(const std::vector<std::string>& names, long long expiresAt) override;
+
+	std::vector<bool> extendUserKeys(const std::vector<std::string>& names, long long expiresAt, std::vector<std::string>& codes) override;
+
+	std::vector<std::string> expire(long long now, size_t limit) override;
+
+	std::string claim(const UserRecord& user, long long expiresAt) override;
+
+	std::string reserveKey(const std::string& code, long long expiresAt, KeyRecord& previous) override;
+
+	void releaseKey(const KeyRecord& previous) override;
+
+	bool addUser(const UserRecord& user) override;
+
+public:
+
+	explicit MemoryStorage(const std::string& path);
+
+	~MemoryStorage() override;
+
+	std::optional<UserRecord> getUser(const std::string& name) override;
+
+	std::optional<KeyRecord> getKey(const std::string& name) override;
+
+	void listNames(std::vector<std::string>& userNames, std::vector<std::string>& keyNames) override;
+
+	std::vector<long long> pendingExpiries() override;
+
+	void setPassword(const std::string& name, const std::string& password) override;
+};
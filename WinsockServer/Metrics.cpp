@@ -0,0 +1,3 @@
+#include "Metrics.h"
+
+Metrics metrics;
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <sstream>
+
+// Named counters shared by the whole server. Hot paths should look a counter up once and keep
+// the reference, since get() takes a lock.
+class Metrics
+{
+	mutable std::mutex							mutex;
+	std::map<std::string, std::atomic<long long>>	values;
+
+public:
+
+	std::atomic<long long>& get(const std::string& name) {
+
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		return values[name];
+	}
+
+	static void setMax(std::atomic<long long>& value, long long candidate) {
+
+		long long current = value.load();
+
+		while (candidate > current && !value.compare_exchange_weak(current, candidate));
+	}
+
+	std::string report() const {
+
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		std::ostringstream stream;
+
+		for (const auto& [name, value] : values)
+			stream << name << " " << value.load() << "\n";
+
+		return stream.str();
+	}
+};
+
+extern Metrics metrics;
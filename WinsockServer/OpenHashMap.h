@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <utility>
+
+// String keyed hash table with open addressing and linear probing. Entries are never
+// removed, which keeps probing free of tombstones. Not synchronized.
+template <typename Value>
+class OpenHashMap
+{
+	struct Slot {
+
+		uint64_t		hash = 0;
+		bool			used = false;
+		std::string		key;
+		Value			value{};
+	};
+
+	std::vector<Slot>	slots;
+	size_t				count = 0;
+
+	static uint64_t hash(const std::string& key) {
+
+		uint64_t hash = 0xCBF29CE484222325ULL;
+
+		for (unsigned char c : key) {
+
+			hash ^= c;
+
+			hash *= 0x100000001B3ULL;
+		}
+
+		hash ^= hash >> 32;
+
+		return hash;
+	}
+
+	size_t probe(const std::string& key, uint64_t keyHash) const {
+
+		size_t mask = slots.size() - 1, index = static_cast<size_t>(keyHash) & mask;
+
+		while (slots[index].used && (slots[index].hash != keyHash || slots[index].key != key))
+			index = (index + 1) & mask;
+
+		return index;
+	}
+
+	void grow() {
+
+		std::vector<Slot> old(slots.size() * 2);
+
+		old.swap(slots);
+
+		for (auto& slot : old) {
+
+			if (!slot.used)
+				continue;
+
+			slots[probe(slot.key, slot.hash)] = std::move(slot);
+		}
+	}
+
+public:
+
+	explicit OpenHashMap(size_t capacity = 1024) {
+
+		size_t size = 16;
+
+		while (size < capacity * 2)
+			size *= 2;
+
+		slots.resize(size);
+	}
+
+	const Value* get(const std::string& key) const {
+
+		const Slot& slot = slots[probe(key, hash(key))];
+
+		return slot.used ? &slot.value : nullptr;
+	}
+
+	Value* get(const std::string& key) {
+
+		Slot& slot = slots[probe(key, hash(key))];
+
+		return slot.used ? &slot.value : nullptr;
+	}
+
+	// Returns the value for key, default constructing it first if it isn't there yet.
+	std::pair<Value*, bool> insert(const std::string& key) {
+
+		if ((count + 1) * 10 > slots.size() * 7)
+			grow();
+
+		uint64_t keyHash = hash(key);
+
+		Slot& slot = slots[probe(key, keyHash)];
+
+		if (slot.used)
+			return { &slot.value, false };
+
+		slot.used	= true;
+		slot.hash	= keyHash;
+		slot.key	= key;
+
+		count++;
+
+		return { &slot.value, true };
+	}
+
+	size_t size() const {
+
+		return count;
+	}
+
+	template <typename Function>
+	void forEach(Function function) const {
+
+		for (const auto& slot : slots) {
+
+			if (slot.used)
+				function(slot.key, slot.value);
+		}
+	}
+};
@@ -0,0 +1,61 @@
+#include "PasswordHasher.h"
+#include <sstream>
+#include <algorithm>
+
+PasswordHasher::PasswordHasher(ULONGLONG iterations, size_t threads, size_t maxQueued) :
+	iterations{ iterations }, pool{ "password", threads, maxQueued } {}
+
+std::future<std::string> PasswordHasher::hash(const std::string& password) {
+
+	return pool.submit([this, password] {
+
+		auto salt = randomBytes(saltSize);
+
+		auto key = pbkdf2Sha256(password, salt, iterations, hashSize);
+
+		return "pbkdf2$" + std::to_string(iterations) + "$" + toHex(salt.data(), salt.size()) + "$" + toHex(key.data(), key.size());
+	});
+}
+
+std::future<bool> PasswordHasher::verify(const std::string& password, const std::string& stored) {
+
+	return pool.submit([password, stored] {
+
+		if (!isHashed(stored))
+			return constantTimeEqual({ password.begin(), password.end() }, { stored.begin(), stored.end() });
+
+		std::istringstream fields{ stored.substr(7) };
+
+		std::string storedIterations, storedSalt, storedKey;
+
+		std::getline(fields, storedIterations, '$');
+
+		std::getline(fields, storedSalt, '$');
+
+		std::getline(fields, storedKey, '$');
+
+		std::vector<unsigned char> salt, key;
+
+		if (!fromHex(storedSalt, salt) || !fromHex(storedKey, key) || key.empty())
+			return false;
+
+		ULONGLONG rounds = std::strtoull(storedIterations.c_str(), nullptr, 10);
+
+		if (!rounds)
+			return false;
+
+		return constantTimeEqual(pbkdf2Sha256(password, salt, rounds, key.size()), key);
+	});
+}
+
+bool PasswordHasher::isHashed(const std::string& stored) {
+
+	return stored.compare(0, 7, "pbkdf2$") == 0;
+}
+
+PasswordHasher& passwordHasher() {
+
+	static PasswordHasher hasher{ 600000, std::max(1u, std::thread::hardware_concurrency() / 2), 256 };
+
+	return hasher;
+}
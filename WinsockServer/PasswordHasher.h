@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <future>
+#include "ComputePool.h"
+#include "Crypto.h"
+
+// Hashes and verifies passwords on a dedicated ComputePool. Stored hashes have the form
+// pbkdf2$iterations$salt$hash with salt and hash in hex; anything else is a legacy plain
+// text password, which verify() still accepts so it can be rehashed on the next login.
+class PasswordHasher
+{
+	ULONGLONG		iterations;
+	ComputePool		pool;
+
+	static constexpr size_t		saltSize	= 16;
+	static constexpr size_t		hashSize	= 32;
+
+public:
+
+	PasswordHasher(ULONGLONG iterations, size_t threads, size_t maxQueued);
+
+	PasswordHasher(const PasswordHasher& other)				= delete;
+
+	PasswordHasher& operator=(const PasswordHasher& other)	= delete;
+
+	std::future<std::string> hash(const std::string& password);
+
+	std::future<bool> verify(const std::string& password, const std::string& stored);
+
+	static bool isHashed(const std::string& stored);
+};
+
+PasswordHasher& passwordHasher();
@@ -0,0 +1,276 @@
+#include "Payload.h"
+#include "Utils.h"
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
+Payload::Payload(const std::string& imagePath, const std::string& offsetsPath, const std::string& cacheDirectory, size_t streamingThreshold) {
+
+	if (!getOffsets(offsetsPath, offsets))
+		throw std::runtime_error("Failed to load offsets " + offsetsPath);
+
+	std::error_code error;
+
+	if (std::filesystem::file_size(imagePath, error) > streamingThreshold && !error) {
+
+		streamImage(imagePath, cacheDirectory);
+
+		return;
+	}
+
+	std::vector<char> imageBytes;
+
+	if (!getImageBytes(imagePath, imageBytes))
+		throw std::runtime_error("Failed to load image " + imagePath);
+
+	hash = sha256(imageBytes.data(), imageBytes.size());
+
+	for (size_t offset = 0; offset < imageBytes.size(); offset += PAYLOAD_CHUNK_SIZE)
+		chunkHashes.push_back(sha256(imageBytes.data() + offset, std::min<size_t>(PAYLOAD_CHUNK_SIZE, imageBytes.size() - offset)));
+
+	imageSize	= imageBytes.size();
+	image		= std::make_shared<const PayloadBuffer>(std::move(imageBytes));
+}
+
+// Images too large for the cache budget are never held in memory. They are copied into the
+// cache directory block by block while being hashed, and sent straight from that copy.
+void Payload::streamImage(const std::string& imagePath, const std::string& cacheDirectory) {
+
+	std::filesystem::create_directories(cacheDirectory);
+
+	std::string temporaryPath = (std::filesystem::path{ cacheDirectory } / (std::to_string(std::hash<std::string>{}(imagePath)) + ".tmp")).string();
+
+	std::ifstream ifile{ imagePath, std::ios::binary };
+
+	std::ofstream ofile{ temporaryPath, std::ios::binary | std::ios::trunc };
+
+	if (!ifile || !ofile)
+		throw std::runtime_error("Failed to stream image " + imagePath);
+
+	Sha256 imageHash;
+
+	std::vector<char> block(PAYLOAD_CHUNK_SIZE);
+
+	while (ifile.read(block.data(), block.size()) || ifile.gcount()) {
+
+		size_t length = static_cast<size_t>(ifile.gcount());
+
+		imageHash.update(block.data(), length);
+
+		chunkHashes.push_back(sha256(block.data(), length));
+
+		ofile.write(block.data(), length);
+
+		imageSize += length;
+	}
+
+	ifile.close();
+
+	ofile.close();
+
+	if (!ofile)
+		throw std::runtime_error("Failed to write " + temporaryPath);
+
+	hash		= imageHash.finish();
+	spillPath	= (std::filesystem::path{ cacheDirectory } / (toHex(hash.data(), hash.size()) + ".bin")).string();
+	streamed	= true;
+
+	if (std::filesystem::exists(spillPath))
+		std::filesystem::remove(temporaryPath);
+	else
+		std::filesystem::rename(temporaryPath, spillPath);
+}
+
+bool Payload::sendImage(BandwidthScheduler::Flow& flow, const char* clientHash) const {
+
+	IMAGE_HDR header{};
+
+	std::copy(hash.begin(), hash.end(), header.hash);
+
+	Digest base{};
+
+	std::memcpy(base.data(), clientHash, base.size());
+
+	if (base == hash) {
+
+		header.status = IMAGE_NOT_MODIFIED;
+
+		return flow.send(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+
+	if (auto patch = findPatch(base)) {
+
+		header.status	= IMAGE_PATCH;
+		header.size		= patch->size();
+
+		if (!flow.send(reinterpret_cast<const char*>(&header), sizeof(header)))
+			return false;
+
+		return flow.send(patch->data(), patch->size());
+	}
+
+	header.status	= IMAGE_FULL;
+	header.size		= imageSize;
+
+	if (!flow.send(reinterpret_cast<const char*>(&header), sizeof(header)))
+		return false;
+
+	return sendImageRange(flow, 0, imageSize);
+}
+
+bool Payload::sendImageRange(BandwidthScheduler::Flow& flow, size_t begin, size_t end) const {
+
+	if (streamed)
+		return sendFile(spillPath, begin, end - begin, streamBufferSize, [&](const char* data, size_t size) { return flow.send(data, size); });
+
+	auto buffer = getImage();
+
+	return flow.send(buffer->data() + begin, end - begin);
+}
+
+bool Payload::sendOffsets(BandwidthScheduler::Flow& flow) const {
+
+	return flow.send(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uintptr_t));
+}
+
+bool Payload::sendManifest(BandwidthScheduler::Flow& flow) const {
+
+	MANIFEST_HDR header{};
+
+	header.status		= IMAGE_FULL;
+	header.imageSize	= getImageSize();
+	header.chunkSize	= PAYLOAD_CHUNK_SIZE;
+	header.chunkCount	= chunkHashes.size();
+	header.offsetsSize	= offsets.size() * sizeof(uintptr_t);
+
+	std::copy(hash.begin(), hash.end(), header.hash);
+
+	if (!flow.send(reinterpret_cast<const char*>(&header), sizeof(header)))
+		return false;
+
+	if (!flow.send(reinterpret_cast<const char*>(chunkHashes.data()), chunkHashes.size() * sizeof(Digest)))
+		return false;
+
+	return sendOffsets(flow);
+}
+
+bool Payload::sendChunks(BandwidthScheduler::Flow& flow, const CHUNK_RANGE& range) const {
+
+	CHUNK_HDR header{};
+
+	header.status	= IMAGE_FULL;
+	header.first	= std::min<ULONGLONG>(range.first, chunkHashes.size());
+	header.count	= std::min<ULONGLONG>(range.count, chunkHashes.size() - header.first);
+
+	size_t begin	= static_cast<size_t>(header.first * PAYLOAD_CHUNK_SIZE);
+	size_t end		= std::min<size_t>(static_cast<size_t>((header.first + header.count) * PAYLOAD_CHUNK_SIZE), imageSize);
+
+	header.size = end - begin;
+
+	if (!flow.send(reinterpret_cast<const char*>(&header), sizeof(header)))
+		return false;
+
+	return sendImageRange(flow, begin, end);
+}
+
+void Payload::addPatch(const Digest& base, std::vector<char> patch) {
+
+	std::lock_guard<std::mutex> lock{ patchMutex };
+
+	patches[base] = std::make_shared<const std::vector<char>>(std::move(patch));
+}
+
+std::shared_ptr<const std::vector<char>> Payload::findPatch(const Digest& base) const {
+
+	std::lock_guard<std::mutex> lock{ patchMutex };
+
+	auto patch = patches.find(base);
+
+	if (patch == patches.end())
+		return nullptr;
+
+	return patch->second;
+}
+
+std::shared_ptr<const PayloadBuffer> Payload::getImage() const {
+
+	std::lock_guard<std::mutex> lock{ imageMutex };
+
+	return image;
+}
+
+void Payload::writeSpillFile(const std::string& cacheDirectory) {
+
+	if (streamed)
+		return;
+
+	std::filesystem::create_directories(cacheDirectory);
+
+	std::string path = (std::filesystem::path{ cacheDirectory } / (toHex(hash.data(), hash.size()) + ".bin")).string();
+
+	if (!std::filesystem::exists(path)) {
+
+		auto buffer = getImage();
+
+		std::string temporaryPath = path + ".tmp";
+
+		std::ofstream ofile{ temporaryPath, std::ios::binary | std::ios::trunc };
+
+		ofile.write(buffer->data(), buffer->size());
+
+		ofile.close();
+
+		if (!ofile)
+			throw std::runtime_error("Failed to write " + temporaryPath);
+
+		std::filesystem::rename(temporaryPath, path);
+	}
+
+	std::lock_guard<std::mutex> lock{ imageMutex };
+
+	spillPath = path;
+}
+
+size_t Payload::evict() {
+
+	std::lock_guard<std::mutex> lock{ imageMutex };
+
+	if (streamed || image->isMapped() || spillPath.empty())
+		return 0;
+
+	size_t freedBytes = image->size();
+
+	image = std::make_shared<const PayloadBuffer>(spillPath);
+
+	return freedBytes;
+}
+
+size_t Payload::restore() {
+
+	auto buffer = getImage();
+
+	if (streamed || !buffer->isMapped())
+		return 0;
+
+	auto resident = std::make_shared<const PayloadBuffer>(std::vector<char>(buffer->data(), buffer->data() + buffer->size()));
+
+	std::lock_guard<std::mutex> lock{ imageMutex };
+
+	image = resident;
+
+	return resident->size();
+}
+
+size_t Payload::residentBytes() const {
+
+	auto buffer = getImage();
+
+	return (streamed || buffer->isMapped()) ? 0 : buffer->size();
+}
+
+std::string Payload::getSpillPath() const {
+
+	std::lock_guard<std::mutex> lock{ imageMutex };
+
+	return spillPath;
+}
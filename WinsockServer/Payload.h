@@ -0,0 +1,79 @@
+#pragma once
+
+#include <WinSock2.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include "Crypto.h"
+#include "Protocol.h"
+#include "PayloadBuffer.h"
+#include "BandwidthScheduler.h"
+
+class Payload
+{
+	std::vector<uintptr_t>	offsets;
+	Digest					hash;
+	std::vector<Digest>		chunkHashes;
+	std::string				spillPath;
+	size_t					imageSize = 0;
+	bool					streamed = false;
+
+	static constexpr size_t	streamBufferSize = 0x40000;
+
+	mutable std::mutex								imageMutex;
+	std::shared_ptr<const PayloadBuffer>			image;
+
+	mutable std::mutex										patchMutex;
+	std::map<Digest, std::shared_ptr<const std::vector<char>>>	patches;
+
+public:
+
+	Payload(const std::string& imagePath, const std::string& offsetsPath, const std::string& cacheDirectory, size_t streamingThreshold);
+
+	Payload(const Payload& other)				= delete;
+
+	Payload& operator=(const Payload& other)	= delete;
+
+	bool sendImage(BandwidthScheduler::Flow& flow, const char* clientHash) const;
+
+	bool sendOffsets(BandwidthScheduler::Flow& flow) const;
+
+	bool sendManifest(BandwidthScheduler::Flow& flow) const;
+
+	bool sendChunks(BandwidthScheduler::Flow& flow, const CHUNK_RANGE& range) const;
+
+	void addPatch(const Digest& base, std::vector<char> patch);
+
+	std::shared_ptr<const std::vector<char>> findPatch(const Digest& base) const;
+
+	std::shared_ptr<const PayloadBuffer> getImage() const;
+
+	void writeSpillFile(const std::string& cacheDirectory);
+
+	void streamImage(const std::string& imagePath, const std::string& cacheDirectory);
+
+	bool sendImageRange(BandwidthScheduler::Flow& flow, size_t begin, size_t end) const;
+
+	size_t evict();
+
+	size_t restore();
+
+	size_t residentBytes() const;
+
+	std::string getSpillPath() const;
+
+	const Digest& getHash() const {
+		return hash;
+	}
+
+	size_t getImageSize() const {
+		return imageSize;
+	}
+
+	bool isStreamed() const {
+		return streamed;
+	}
+};
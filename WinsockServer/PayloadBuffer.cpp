@@ -0,0 +1,60 @@
+#include "PayloadBuffer.h"
+
+PayloadBuffer::PayloadBuffer(std::vector<char> bytes) : bytes{ std::move(bytes) } {
+
+	length = this->bytes.size();
+}
+
+PayloadBuffer::PayloadBuffer(const std::string& path) {
+
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("CreateFileA failed with code " + std::to_string(GetLastError()));
+
+	LARGE_INTEGER fileSize{};
+
+	if (!GetFileSizeEx(file, &fileSize)) {
+
+		CloseHandle(file);
+
+		throw std::runtime_error("GetFileSizeEx failed with code " + std::to_string(GetLastError()));
+	}
+
+	length = static_cast<size_t>(fileSize.QuadPart);
+
+	if (!length)
+		return;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (!mapping) {
+
+		CloseHandle(file);
+
+		throw std::runtime_error("CreateFileMappingA failed with code " + std::to_string(GetLastError()));
+	}
+
+	view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+
+	if (!view) {
+
+		CloseHandle(mapping);
+
+		CloseHandle(file);
+
+		throw std::runtime_error("MapViewOfFile failed with code " + std::to_string(GetLastError()));
+	}
+}
+
+PayloadBuffer::~PayloadBuffer() {
+
+	if (view)
+		UnmapViewOfFile(view);
+
+	if (mapping)
+		CloseHandle(mapping);
+
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
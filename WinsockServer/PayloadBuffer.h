@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Windows.h>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+// Image bytes of one payload version, either held on the heap or mapped read-only from a file.
+class PayloadBuffer
+{
+	std::vector<char>	bytes;
+	HANDLE				file		= INVALID_HANDLE_VALUE;
+	HANDLE				mapping		= nullptr;
+	const char*			view		= nullptr;
+	size_t				length		= 0;
+
+public:
+
+	explicit PayloadBuffer(std::vector<char> bytes);
+
+	explicit PayloadBuffer(const std::string& path);
+
+	~PayloadBuffer();
+
+	PayloadBuffer(const PayloadBuffer& other)				= delete;
+
+	PayloadBuffer& operator=(const PayloadBuffer& other)	= delete;
+
+	const char* data() const {
+		return view ? view : bytes.data();
+	}
+
+	size_t size() const {
+		return length;
+	}
+
+	bool isMapped() const {
+		return file != INVALID_HANDLE_VALUE;
+	}
+};
@@ -0,0 +1,154 @@
+#include "PayloadCache.h"
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+
+PayloadCache::PayloadCache(size_t budget, const std::string& directory) : budget{ budget }, directory{ directory } {
+
+	promoter = std::thread{ &PayloadCache::promote, this };
+}
+
+PayloadCache::~PayloadCache() {
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		running = false;
+	}
+
+	promotionReady.notify_all();
+
+	if (promoter.joinable())
+		promoter.join();
+}
+
+// The spill file is written under the cache lock, so enforceBudget can't delete a file of the
+// same hash for an expired entry between the write and the new entry being registered.
+void PayloadCache::add(const std::shared_ptr<Payload>& payload) {
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	payload->writeSpillFile(directory);
+
+	recent.push_front(Entry{ payload, payload->getSpillPath() });
+
+	enforceBudget();
+}
+
+// Only reorders the entries. An evicted image keeps being served from its mapping until the
+// promoter has copied it back.
+void PayloadCache::touch(const std::shared_ptr<Payload>& payload) {
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	auto entry = std::find_if(recent.begin(), recent.end(), [&](const Entry& entry) { return entry.payload.lock() == payload; });
+
+	if (entry != recent.end() && entry != recent.begin())
+		recent.splice(recent.begin(), recent, entry);
+
+	if (payload->isStreamed() || payload->residentBytes() != 0 || payload->getImageSize() > budget)
+		return;
+
+	bool queued = std::any_of(promotions.begin(), promotions.end(), [&](const std::weak_ptr<Payload>& pending) { return pending.lock() == payload; });
+
+	if (!queued) {
+
+		promotions.push_back(payload);
+
+		promotionReady.notify_one();
+	}
+}
+
+void PayloadCache::promote() {
+
+	std::unique_lock<std::mutex> lock{ mutex };
+
+	while (true) {
+
+		promotionReady.wait(lock, [&] { return !running || !promotions.empty(); });
+
+		if (!running)
+			return;
+
+		auto payload = promotions.front().lock();
+
+		promotions.pop_front();
+
+		if (!payload)
+			continue;
+
+		lock.unlock();
+
+		try {
+
+			payload->restore();
+		}
+		catch (std::exception& ex) {
+
+			std::cerr << "Image restore exception: " << ex.what() << std::endl;
+		}
+
+		payload.reset();
+
+		lock.lock();
+
+		enforceBudget();
+	}
+}
+
+void PayloadCache::enforceBudget() {
+
+	size_t resident = 0;
+
+	for (auto entry = recent.begin(); entry != recent.end();) {
+
+		auto payload = entry->payload.lock();
+
+		if (!payload) {
+
+			std::string spillPath = entry->spillPath;
+
+			entry = recent.erase(entry);
+
+			bool shared = std::any_of(recent.begin(), recent.end(), [&](const Entry& other) { return other.spillPath == spillPath; });
+
+			std::error_code error;
+
+			if (!spillPath.empty() && !shared && std::filesystem::remove(spillPath, error))
+				std::cout << "Removed spill file " << spillPath << std::endl;
+
+			continue;
+		}
+
+		resident += payload->residentBytes();
+
+		entry++;
+	}
+
+	for (auto entry = recent.rbegin(); resident > budget && entry != recent.rend(); entry++) {
+
+		if (std::next(entry) == recent.rend())
+			break;
+
+		auto payload = entry->payload.lock();
+
+		if (!payload)
+			continue;
+
+		// A spill file that can't be mapped leaves the image resident rather than taking the
+		// promoter thread down.
+		try {
+
+			size_t freedBytes = payload->evict();
+
+			if (freedBytes)
+				std::cout << "Evicted image " << toHex(payload->getHash().data(), payload->getHash().size()) << std::endl;
+
+			resident -= freedBytes;
+		}
+		catch (std::exception& ex) {
+
+			std::cerr << "Image eviction exception: " << ex.what() << std::endl;
+		}
+	}
+}
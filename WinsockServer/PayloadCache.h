@@ -0,0 +1,61 @@
+#pragma once
+
+#include <list>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include "Payload.h"
+
+// Keeps the images of all payload versions within a global memory budget. Versions are
+// ordered by last use; the least recently used ones are evicted to read-only mappings of
+// their spill files and served from there. A version that is used again is copied back onto
+// the heap by a background thread, never on the request path. Spill files are deleted once
+// nothing holds their version any more.
+class PayloadCache
+{
+	struct Entry {
+
+		std::weak_ptr<Payload>	payload;
+		std::string				spillPath;
+	};
+
+	size_t								budget;
+	std::string							directory;
+
+	std::mutex							mutex;
+	std::list<Entry>					recent;
+
+	std::deque<std::weak_ptr<Payload>>	promotions;
+	std::condition_variable				promotionReady;
+	bool								running = true;
+	std::thread							promoter;
+
+	void enforceBudget();
+
+	void promote();
+
+public:
+
+	PayloadCache(size_t budget, const std::string& directory = "cache");
+
+	~PayloadCache();
+
+	PayloadCache(const PayloadCache& other)				= delete;
+
+	PayloadCache& operator=(const PayloadCache& other)	= delete;
+
+	void add(const std::shared_ptr<Payload>& payload);
+
+	void touch(const std::shared_ptr<Payload>& payload);
+
+	size_t getBudget() const {
+		return budget;
+	}
+
+	const std::string& getDirectory() const {
+		return directory;
+	}
+};
@@ -0,0 +1,64 @@
+#include "PayloadCatalog.h"
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+
+PayloadCatalog::PayloadCatalog(const std::string& catalogPath, size_t memoryBudget) : cache{ memoryBudget } {
+
+	if (!std::filesystem::exists(catalogPath))
+		throw std::runtime_error("Catalog " + catalogPath + " doesn't exist");
+
+	std::ifstream ifile{ catalogPath };
+
+	std::string line;
+
+	while (std::getline(ifile, line)) {
+
+		std::istringstream entry{ line };
+
+		std::string product, channel, imagePath, offsetsPath;
+
+		if (!(entry >> product))
+			continue;
+
+		if (!(entry >> channel >> imagePath >> offsetsPath))
+			throw std::runtime_error("Invalid catalog entry: " + line);
+
+		stores[product + "/" + channel] = std::make_unique<PayloadStore>(imagePath, offsetsPath, cache);
+	}
+
+	ifile.close();
+
+	if (stores.empty())
+		throw std::runtime_error("Catalog " + catalogPath + " is empty");
+}
+
+const PayloadStore* PayloadCatalog::findStore(const std::string& product, const std::string& channel) const {
+
+	auto store = stores.find(product + "/" + channel);
+
+	if (store == stores.end())
+		return nullptr;
+
+	return store->second.get();
+}
+
+std::shared_ptr<const Payload> PayloadCatalog::getCurrent(const std::string& product, const std::string& channel) const {
+
+	auto store = findStore(product, channel);
+
+	if (!store)
+		return nullptr;
+
+	return store->getCurrent();
+}
+
+std::shared_ptr<const Payload> PayloadCatalog::find(const std::string& product, const std::string& channel, const Digest& hash) const {
+
+	auto store = findStore(product, channel);
+
+	if (!store)
+		return nullptr;
+
+	return store->find(hash);
+}
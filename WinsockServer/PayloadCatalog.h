@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include "PayloadStore.h"
+#include "PayloadCache.h"
+
+// Every payload the server can hand out, keyed by product and channel. The catalog file has
+// one entry per line: product channel imagePath offsetsPath
+class PayloadCatalog
+{
+	PayloadCache										cache;
+	std::map<std::string, std::unique_ptr<PayloadStore>>	stores;
+
+	const PayloadStore* findStore(const std::string& product, const std::string& channel) const;
+
+public:
+
+	PayloadCatalog(const std::string& catalogPath, size_t memoryBudget);
+
+	PayloadCatalog(const PayloadCatalog& other)				= delete;
+
+	PayloadCatalog& operator=(const PayloadCatalog& other)	= delete;
+
+	std::shared_ptr<const Payload> getCurrent(const std::string& product, const std::string& channel) const;
+
+	std::shared_ptr<const Payload> find(const std::string& product, const std::string& channel, const Digest& hash) const;
+};
@@ -0,0 +1,161 @@
+#include "PayloadStore.h"
+#include "Delta.h"
+#include <iostream>
+
+PayloadStore::PayloadStore(const std::string& imagePath, const std::string& offsetsPath, PayloadCache& cache, size_t historySize) :
+	imagePath{ imagePath }, offsetsPath{ offsetsPath }, historySize{ historySize }, cache{ cache } {
+
+	loadedTime	= lastWriteTime();
+	current		= std::make_shared<Payload>(imagePath, offsetsPath, cache.getDirectory(), cache.getBudget());
+
+	cache.add(current);
+
+	std::cout << "Loaded image " << toHex(current->getHash().data(), current->getHash().size()) << std::endl;
+
+	watcher = std::thread{ &PayloadStore::watch, this };
+}
+
+PayloadStore::~PayloadStore() {
+
+	running = false;
+
+	if (watcher.joinable())
+		watcher.join();
+}
+
+std::shared_ptr<const Payload> PayloadStore::getCurrent() const {
+
+	std::shared_ptr<Payload> payload;
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		payload = current;
+	}
+
+	cache.touch(payload);
+
+	return payload;
+}
+
+std::shared_ptr<const Payload> PayloadStore::find(const Digest& hash) const {
+
+	std::shared_ptr<Payload> payload;
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		if (current->getHash() == hash)
+			payload = current;
+
+		for (const auto& version : history) {
+
+			if (!payload && version->getHash() == hash)
+				payload = version;
+		}
+	}
+
+	if (payload)
+		cache.touch(payload);
+
+	return payload;
+}
+
+std::filesystem::file_time_type PayloadStore::lastWriteTime() const {
+
+	std::error_code error;
+
+	auto imageTime		= std::filesystem::last_write_time(imagePath, error);
+	auto offsetsTime	= std::filesystem::last_write_time(offsetsPath, error);
+
+	return std::max(imageTime, offsetsTime);
+}
+
+void PayloadStore::watch() {
+
+	auto seenTime = loadedTime;
+
+	while (running) {
+
+		for (int i = 0; i < 30 && running; i++)
+			Sleep(1000);
+
+		auto writeTime = lastWriteTime();
+
+		// Only reload once the files have stopped changing for a full interval, so a
+		// half copied release is never picked up.
+		if (writeTime != loadedTime && writeTime == seenTime) {
+
+			try {
+
+				reload();
+
+				loadedTime = writeTime;
+			}
+			catch (std::exception& ex) {
+
+				std::cerr << "Payload reload exception: " << ex.what() << std::endl;
+			}
+		}
+
+		seenTime = writeTime;
+	}
+}
+
+void PayloadStore::reload() {
+
+	auto payload = std::make_shared<Payload>(imagePath, offsetsPath, cache.getDirectory(), cache.getBudget());
+
+	std::deque<std::shared_ptr<Payload>> bases;
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		if (payload->getHash() == current->getHash())
+			return;
+
+		history.push_front(current);
+
+		while (history.size() > historySize)
+			history.pop_back();
+
+		bases	= history;
+		current	= payload;
+	}
+
+	cache.add(payload);
+
+	std::cout << "Loaded image " << toHex(payload->getHash().data(), payload->getHash().size()) << std::endl;
+
+	buildPatches(payload, bases);
+}
+
+void PayloadStore::buildPatches(const std::shared_ptr<Payload>& target, const std::deque<std::shared_ptr<Payload>>& bases) {
+
+	for (const auto& base : bases) {
+
+		if (base->getHash() == target->getHash() || base->isStreamed() || target->isStreamed())
+			continue;
+
+		auto baseImage		= base->getImage();
+		auto targetImage	= target->getImage();
+
+		std::vector<char> patch = makeDelta(baseImage->data(), baseImage->size(), targetImage->data(), targetImage->size());
+
+		std::vector<char> check;
+
+		if (!applyDelta(baseImage->data(), baseImage->size(), patch, check) || check.size() != targetImage->size() || !std::equal(check.begin(), check.end(), targetImage->data())) {
+
+			std::cerr << "Patch from " << toHex(base->getHash().data(), base->getHash().size()) << " failed verification.\n";
+
+			continue;
+		}
+
+		if (patch.size() >= targetImage->size())
+			continue;
+
+		std::cout << "Built patch from " << toHex(base->getHash().data(), base->getHash().size()) << " (" << patch.size() << " bytes)\n";
+
+		target->addPatch(base->getHash(), std::move(patch));
+	}
+}
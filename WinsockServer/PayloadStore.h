@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <filesystem>
+#include "Payload.h"
+#include "PayloadCache.h"
+
+// Owns the payload served on LOGIN. A background thread reloads it when the files on disk
+// change, keeps the last few versions and builds a patch from each of them to the new one.
+class PayloadStore
+{
+	std::string								imagePath;
+	std::string								offsetsPath;
+	size_t									historySize;
+	PayloadCache&							cache;
+
+	mutable std::mutex						mutex;
+	std::shared_ptr<Payload>				current;
+	std::deque<std::shared_ptr<Payload>>	history;
+
+	std::filesystem::file_time_type			loadedTime;
+	std::atomic<bool>						running{ true };
+	std::thread								watcher;
+
+	void watch();
+
+	void reload();
+
+	void buildPatches(const std::shared_ptr<Payload>& target, const std::deque<std::shared_ptr<Payload>>& bases);
+
+	std::filesystem::file_time_type lastWriteTime() const;
+
+public:
+
+	PayloadStore(const std::string& imagePath, const std::string& offsetsPath, PayloadCache& cache, size_t historySize = 4);
+
+	~PayloadStore();
+
+	PayloadStore(const PayloadStore& other)				= delete;
+
+	PayloadStore& operator=(const PayloadStore& other)	= delete;
+
+	std::shared_ptr<const Payload> getCurrent() const;
+
+	std::shared_ptr<const Payload> find(const Digest& hash) const;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <WinSock2.h>
+
+#define LOGIN		0x5CD100F
+#define REGISTER	0x20CC1D
+#define ADDKEY      0x4411969
+#define VALIDATE    0x988CCD
+#define MANIFEST    0x3A7E11F
+#define CHUNKS      0x6C0B5D2
+#define STATS       0x5A7D0E1
+#define REBUILD     0x2EB17D4
+#define RESUME      0x7E5D3A1
+#define IMPORTKEYS  0x1B3F7A9
+#define GENKEYS     0x4D29E63
+#define VALIDATEALL 0x63A0C4B
+
+#define IMAGE_FULL			0x1
+#define IMAGE_NOT_MODIFIED	0x2
+#define IMAGE_PATCH			0x3
+#define IMAGE_GONE			0x4
+
+#define PAYLOAD_CHUNK_SIZE	0x100000
+
+struct CONN_REQ {
+
+	ULONGLONG	requestType;
+	char		name[32];
+	char		password[32];
+	char		key[32];
+	char		extra[32];
+};
+
+// Sent before the image bytes. On LOGIN the client puts the hash of the image it already
+// has into CONN_REQ::extra; if it matches, status is IMAGE_NOT_MODIFIED and size is 0.
+// If it matches an older version the server has a patch for, status is IMAGE_PATCH and
+// size bytes of a patch (see Delta.h) follow instead of the image. hash is always the
+// hash of the current image.
+struct IMAGE_HDR {
+
+	ULONGLONG		status;
+	ULONGLONG		size;
+	unsigned char	hash[32];
+};
+
+// Reply to MANIFEST, after the authentication response. The client asks for a version by
+// putting its hash into CONN_REQ::extra (all zero means the current one). chunkCount
+// SHA-256 chunk hashes follow the header, then the offsets.
+struct MANIFEST_HDR {
+
+	ULONGLONG		status;
+	ULONGLONG		imageSize;
+	ULONGLONG		chunkSize;
+	ULONGLONG		chunkCount;
+	ULONGLONG		offsetsSize;
+	unsigned char	hash[32];
+};
+
+// CHUNKS carries the version hash in CONN_REQ::extra and a CHUNK_RANGE in CONN_REQ::key.
+struct CHUNK_RANGE {
+
+	ULONGLONG	first;
+	ULONGLONG	count;
+};
+
+// Reply to CHUNKS, after the authentication response. size bytes of image data follow,
+// starting at first * chunkSize.
+struct CHUNK_HDR {
+
+	ULONGLONG	status;
+	ULONGLONG	first;
+	ULONGLONG	count;
+	ULONGLONG	size;
+};
+
+// Sent right after "Logged in" and "Resumed". To reattach after a dropped connection the
+// client sends RESUME with its name in CONN_REQ::name and this token in CONN_REQ::key;
+// no password, database lookup or payload transfer is involved. A token is good for one
+// resume only: nonce is the session's generation, which changes every time a token is issued.
+struct SESSION_TOKEN {
+
+	ULONGLONG		expires;
+	ULONGLONG		nonce;
+	unsigned char	mac[16];
+};
+
+// IMPORTKEYS carries admin credentials and, in the first eight bytes of CONN_REQ::key, the
+// length of a newline separated key list that follows the request. The reply is a text
+// summary followed by one line per duplicate key.
+
+// GENKEYS carries admin credentials, a KEY_GENERATION in CONN_REQ::key and optionally the
+// key alphabet in CONN_REQ::extra. The new keys are sent back one per line as each batch
+// is committed, followed by a final "Keys generated: N" line, or by an error line when the
+// key space ran out before N new keys were found.
+struct KEY_GENERATION {
+
+	ULONGLONG	count;
+	ULONGLONG	length;
+};
+
+// VALIDATEALL carries admin credentials and, in the first eight bytes of CONN_REQ::key, the
+// length of a newline separated list that follows the request. The list names keys, or
+// users when CONN_REQ::extra is "users". The reply has one outcome line per name and a
+// final "Keys validated: N" line.
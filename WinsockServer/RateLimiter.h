@@ -0,0 +1,137 @@
+#pragma once
+
+#include <WinSock2.h>
+#include <ws2tcpip.h>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include "Metrics.h"
+
+// Token buckets in a fixed table indexed by the hash of the limited key, so memory stays
+// bounded no matter how many peers show up. Keys that collide share a bucket, which can only
+// make limiting stricter. Each bucket is one 64 bit word updated with compare and swap:
+// the high 44 bits hold the last refill time in milliseconds (0 means never used) and the
+// low 20 bits the tokens left in sixteenths.
+class RateLimiter
+{
+	std::vector<std::atomic<uint64_t>>		buckets;
+	uint64_t								mask;
+	uint64_t								ratePerSecond;
+	uint64_t								burst;
+
+	std::chrono::steady_clock::time_point	start;
+
+	std::atomic<long long>&					admitted;
+	std::atomic<long long>&					rejected;
+
+	static constexpr uint64_t				tokenBits	= 20;
+	static constexpr uint64_t				tokenMask	= (1ULL << tokenBits) - 1;
+	static constexpr uint64_t				tokenUnit	= 16;
+
+	static uint64_t hash(const char* data, size_t size) {
+
+		uint64_t hash = 0xCBF29CE484222325ULL;
+
+		for (size_t i = 0; i < size; i++) {
+
+			hash ^= static_cast<unsigned char>(data[i]);
+
+			hash *= 0x100000001B3ULL;
+		}
+
+		return hash ^ (hash >> 32);
+	}
+
+	bool admit(uint64_t key) {
+
+		auto& bucket = buckets[key & mask];
+
+		uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()) + 1;
+
+		uint64_t capacity = burst * tokenUnit;
+
+		uint64_t current = bucket.load(std::memory_order_relaxed);
+
+		while (true) {
+
+			uint64_t lastRefill	= current >> tokenBits;
+			uint64_t tokens		= current & tokenMask;
+
+			if (!lastRefill || now < lastRefill)
+				tokens = capacity;
+			else
+				tokens = std::min(capacity, tokens + (now - lastRefill) * ratePerSecond * tokenUnit / 1000);
+
+			if (tokens < tokenUnit) {
+
+				rejected++;
+
+				return false;
+			}
+
+			uint64_t updated = (now << tokenBits) | (tokens - tokenUnit);
+
+			if (bucket.compare_exchange_weak(current, updated, std::memory_order_relaxed)) {
+
+				admitted++;
+
+				return true;
+			}
+		}
+	}
+
+public:
+
+	RateLimiter(const std::string& name, size_t bucketCountLog2, uint64_t ratePerSecond, uint64_t burst) :
+		buckets(size_t{ 1 } << bucketCountLog2),
+		mask{ (uint64_t{ 1 } << bucketCountLog2) - 1 },
+		ratePerSecond{ ratePerSecond },
+		burst{ std::min(burst, tokenMask / tokenUnit) },
+		start{ std::chrono::steady_clock::now() },
+		admitted{ metrics.get(name + ".admitted") },
+		rejected{ metrics.get(name + ".rejected") } {}
+
+	RateLimiter(const RateLimiter& other)				= delete;
+
+	RateLimiter& operator=(const RateLimiter& other)	= delete;
+
+	bool admit(const std::string& key) {
+
+		return admit(hash(key.data(), key.size()));
+	}
+
+	// IPv4 peers are limited per address, IPv6 peers per /64 since one host usually owns
+	// the whole prefix.
+	static std::string addressPrefix(const SOCKADDR* address) {
+
+		if (address->sa_family == AF_INET6) {
+
+			const auto& ipv6 = reinterpret_cast<const SOCKADDR_IN6*>(address)->sin6_addr;
+
+			return std::string(reinterpret_cast<const char*>(&ipv6), 8);
+		}
+
+		const auto& ipv4 = reinterpret_cast<const SOCKADDR_IN*>(address)->sin_addr;
+
+		return std::string(reinterpret_cast<const char*>(&ipv4), sizeof(ipv4));
+	}
+
+	bool admit(const SOCKADDR* address) {
+
+		std::string prefix = addressPrefix(address);
+
+		return admit(hash(prefix.data(), prefix.size()));
+	}
+
+	// Limits a key per peer, so requests naming an account from one address can't drain the
+	// bucket that account's owner uses from another.
+	bool admit(const SOCKADDR* address, const std::string& key) {
+
+		std::string limited = addressPrefix(address) + key;
+
+		return admit(hash(limited.data(), limited.size()));
+	}
+};
@@ -0,0 +1,124 @@
+#include "SessionRegistry.h"
+
+SessionRegistry::SessionRegistry(SessionTokens& tokens) : tokens{ tokens } {}
+
+std::string SessionRegistry::login(User& user, SESSION_TOKEN& token) {
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	std::string response = user.login(users);
+
+	if (response != "Logged in")
+		return response;
+
+	sessionsByKey[user.getCode()].insert(user.getName());
+
+	ULONGLONG generation = SessionTokens::newGeneration();
+
+	generations[user.getName()] = generation;
+
+	token = tokens.issue(user.getName(), user.getCode(), generation);
+
+	return response;
+}
+
+std::string SessionRegistry::resume(SOCKET connection, const std::string& name, const SESSION_TOKEN& token, std::string& code, SESSION_TOKEN& next) {
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	// Checked before the token is consumed, so a client that is still logged in elsewhere
+	// keeps its parked session and can resume once that connection is gone.
+	if (users.count(name))
+		return std::string("Already logged in");
+
+	if (!tokens.reattach(name, token, code))
+		return std::string("Session expired");
+
+	User user{ connection, name, "", nullptr, code };
+
+	user.login(users);
+
+	sessionsByKey[code].insert(name);
+
+	ULONGLONG generation = SessionTokens::newGeneration();
+
+	generations[name] = generation;
+
+	next = tokens.issue(name, code, generation);
+
+	return std::string("Resumed");
+}
+
+bool SessionRegistry::logout(const std::string& name) {
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	auto user = users.find(name);
+
+	if (user == users.end())
+		return false;
+
+	auto sessions = sessionsByKey.find(user->second.getCode());
+
+	if (sessions != sessionsByKey.end()) {
+
+		sessions->second.erase(name);
+
+		if (sessions->second.empty())
+			sessionsByKey.erase(sessions);
+	}
+
+	tokens.detach(name, user->second.getCode(), generations[name]);
+
+	generations.erase(name);
+
+	users.erase(user);
+
+	return true;
+}
+
+std::vector<std::string> SessionRegistry::revokeKey(const std::string& code) {
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	tokens.revoke(code);
+
+	auto sessions = sessionsByKey.find(code);
+
+	if (sessions == sessionsByKey.end())
+		return {};
+
+	std::vector<std::string> names{ sessions->second.begin(), sessions->second.end() };
+
+	sessionsByKey.erase(sessions);
+
+	for (const auto& name : names) {
+
+		auto user = users.find(name);
+
+		if (user == users.end())
+			continue;
+
+		shutdown(user->second.getConnection(), SD_BOTH);
+
+		generations.erase(name);
+
+		users.erase(user);
+	}
+
+	return names;
+}
+
+std::vector<User> SessionRegistry::snapshot() {
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	std::vector<User> loggedIn;
+
+	loggedIn.reserve(users.size());
+
+	for (const auto& user : users)
+		loggedIn.push_back(user.second);
+
+	return loggedIn;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "User.h"
+#include "SessionTokens.h"
+
+// Every logged in user, indexed by name and by the key they logged in with. Logging out
+// parks the session with the token issuer so it can be resumed; revoking a key closes and
+// forgets every session on it, parked or live. Each login and resume starts a new session
+// generation and hands out a token for it, so a token stops working once it has been used.
+// All of it happens under one lock so a session can never be resumed past a revocation.
+class SessionRegistry
+{
+	SessionTokens&													tokens;
+
+	std::mutex														mutex;
+	std::unordered_map<std::string, User>							users;
+	std::unordered_map<std::string, ULONGLONG>						generations;
+	std::unordered_map<std::string, std::unordered_set<std::string>>	sessionsByKey;
+
+public:
+
+	explicit SessionRegistry(SessionTokens& tokens);
+
+	SessionRegistry(const SessionRegistry& other)				= delete;
+
+	SessionRegistry& operator=(const SessionRegistry& other)	= delete;
+
+	std::string login(User& user, SESSION_TOKEN& token);
+
+	std::string resume(SOCKET connection, const std::string& name, const SESSION_TOKEN& token, std::string& code, SESSION_TOKEN& next);
+
+	bool logout(const std::string& name);
+
+	std::vector<std::string> revokeKey(const std::string& code);
+
+	std::vector<User> snapshot();
+};
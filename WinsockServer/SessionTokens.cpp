@@ -0,0 +1,133 @@
+#include "SessionTokens.h"
+#include "Crypto.h"
+#include <cstring>
+
+SessionTokens::SessionTokens(std::time_t lifetime, std::time_t gracePeriod) :
+	secret{ randomBytes(32) }, lifetime{ lifetime }, gracePeriod{ gracePeriod } {}
+
+void SessionTokens::sign(const std::string& name, const std::string& code, SESSION_TOKEN& token) const {
+
+	std::string message = name + '\0' + code + '\0';
+
+	message.append(reinterpret_cast<const char*>(&token.expires), sizeof(token.expires));
+
+	message.append(reinterpret_cast<const char*>(&token.nonce), sizeof(token.nonce));
+
+	Digest mac = hmacSha256(secret, message);
+
+	std::memcpy(token.mac, mac.data(), sizeof(token.mac));
+}
+
+ULONGLONG SessionTokens::newGeneration() {
+
+	ULONGLONG generation = 0;
+
+	auto bytes = randomBytes(sizeof(generation));
+
+	std::memcpy(&generation, bytes.data(), sizeof(generation));
+
+	return generation;
+}
+
+SESSION_TOKEN SessionTokens::issue(const std::string& name, const std::string& code, ULONGLONG generation) const {
+
+	SESSION_TOKEN token{};
+
+	token.expires	= static_cast<ULONGLONG>(std::time(nullptr) + lifetime);
+	token.nonce		= generation;
+
+	sign(name, code, token);
+
+	return token;
+}
+
+void SessionTokens::forget(std::unordered_map<std::string, DetachedSession>::iterator session) {
+
+	auto names = detachedByKey.find(session->second.code);
+
+	if (names != detachedByKey.end()) {
+
+		names->second.erase(session->first);
+
+		if (names->second.empty())
+			detachedByKey.erase(names);
+	}
+
+	detached.erase(session);
+}
+
+// Every session is parked for the same grace period, so expiries queue up in order and only
+// the ones that are due get looked at. Entries for sessions that were resumed, revoked or
+// parked again since are skipped.
+void SessionTokens::detach(const std::string& name, const std::string& code, ULONGLONG generation) {
+
+	std::time_t now = std::time(nullptr);
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	while (!expiries.empty() && expiries.front().first <= now) {
+
+		auto session = detached.find(expiries.front().second);
+
+		if (session != detached.end() && session->second.expires == expiries.front().first)
+			forget(session);
+
+		expiries.pop_front();
+	}
+
+	auto session = detached.find(name);
+
+	if (session != detached.end())
+		forget(session);
+
+	detached.emplace(name, DetachedSession{ code, generation, now + gracePeriod });
+
+	detachedByKey[code].insert(name);
+
+	expiries.emplace_back(now + gracePeriod, name);
+}
+
+bool SessionTokens::reattach(const std::string& name, const SESSION_TOKEN& token, std::string& code) {
+
+	std::time_t now = std::time(nullptr);
+
+	if (token.expires <= static_cast<ULONGLONG>(now))
+		return false;
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	auto session = detached.find(name);
+
+	if (session == detached.end() || session->second.expires <= now || session->second.generation != token.nonce)
+		return false;
+
+	SESSION_TOKEN expected = token;
+
+	sign(name, session->second.code, expected);
+
+	std::vector<unsigned char> first(token.mac, token.mac + sizeof(token.mac)), second(expected.mac, expected.mac + sizeof(expected.mac));
+
+	if (!constantTimeEqual(first, second))
+		return false;
+
+	code = session->second.code;
+
+	forget(session);
+
+	return true;
+}
+
+void SessionTokens::revoke(const std::string& code) {
+
+	std::lock_guard<std::mutex> lock{ mutex };
+
+	auto names = detachedByKey.find(code);
+
+	if (names == detachedByKey.end())
+		return;
+
+	for (const auto& name : names->second)
+		detached.erase(name);
+
+	detachedByKey.erase(names);
+}
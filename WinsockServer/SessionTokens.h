@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <ctime>
+#include "Protocol.h"
+
+// Issues and checks the HMAC signed tokens that let a client reattach to its session. The
+// secret is generated at startup, so tokens never outlive the process. When a logged in
+// client disconnects its session is kept detached for a grace window; a valid token for a
+// detached session brings it back without touching the database. Each token carries the
+// generation of the session it was issued for, and only the latest generation of a detached
+// session is accepted, once.
+class SessionTokens
+{
+	struct DetachedSession {
+
+		std::string		code;
+		ULONGLONG		generation;
+		std::time_t		expires;
+	};
+
+	std::vector<unsigned char>					secret;
+	std::time_t									lifetime;
+	std::time_t									gracePeriod;
+
+	std::mutex																mutex;
+	std::unordered_map<std::string, DetachedSession>						detached;
+	std::unordered_map<std::string, std::unordered_set<std::string>>		detachedByKey;
+	std::deque<std::pair<std::time_t, std::string>>							expiries;
+
+	void sign(const std::string& name, const std::string& code, SESSION_TOKEN& token) const;
+
+	void forget(std::unordered_map<std::string, DetachedSession>::iterator session);
+
+public:
+
+	SessionTokens(std::time_t lifetime, std::time_t gracePeriod);
+
+	SessionTokens(const SessionTokens& other)				= delete;
+
+	SessionTokens& operator=(const SessionTokens& other)	= delete;
+
+	static ULONGLONG newGeneration();
+
+	SESSION_TOKEN issue(const std::string& name, const std::string& code, ULONGLONG generation) const;
+
+	void detach(const std::string& name, const std::string& code, ULONGLONG generation);
+
+	bool reattach(const std::string& name, const SESSION_TOKEN& token, std::string& code);
+
+	void revoke(const std::string& code);
+};
@@ -0,0 +1,400 @@
+#include "ShardedStorage.h"
+#include <future>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+
+size_t ShardedStorage::shardIndex(const std::string& name, size_t shardCount) {
+
+	unsigned long long hash = 14695981039346656037ULL;
+
+	for (unsigned char c : name) {
+
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+
+	// FNV's low bits mix poorly, so fold the high half in before reducing.
+	hash ^= hash >> 32;
+
+	return static_cast<size_t>(hash % shardCount);
+}
+
+// A single shard keeps the original file name, so an unsharded database is shard 0 of 1.
+std::string ShardedStorage::shardPath(const std::string& baseName, size_t shard, size_t shardCount) {
+
+	if (shardCount == 1)
+		return baseName + ".db";
+
+	return baseName + "." + std::to_string(shard) + ".db";
+}
+
+ShardedStorage::ShardedStorage(const std::string& baseName, size_t shardCount) {
+
+	if (shardCount == 0)
+		throw std::runtime_error("Shard count must be at least 1");
+
+	for (size_t shard = 0; shard < shardCount; shard++)
+		shards.push_back(std::make_unique<Database>(shardPath(baseName, shard, shardCount), readersPerShard));
+}
+
+Database& ShardedStorage::shardFor(const std::string& name) {
+
+	return *shards[shardIndex(name, shards.size())];
+}
+
+// Splits names by shard, runs apply on every shard that got any at the same time, and puts
+// the per-name results back in the caller's order.
+template<typename Result, typename Apply>
+std::vector<Result> ShardedStorage::fanOut(const std::vector<std::string>& names, Apply apply) {
+
+	std::vector<std::vector<std::string>> parts(shards.size());
+
+	std::vector<size_t> placement(names.size());
+
+	for (size_t i = 0; i < names.size(); i++) {
+
+		placement[i] = shardIndex(names[i], shards.size());
+
+		parts[placement[i]].push_back(names[i]);
+	}
+
+	std::vector<std::future<std::vector<Result>>> pending(shards.size());
+
+	for (size_t shard = 0; shard < shards.size(); shard++) {
+
+		if (!parts[shard].empty())
+			pending[shard] = std::async(std::launch::async, [&, shard] { return apply(*shards[shard], parts[shard]); });
+	}
+
+	std::vector<std::vector<Result>> results(shards.size());
+
+	for (size_t shard = 0; shard < shards.size(); shard++) {
+
+		if (pending[shard].valid())
+			results[shard] = pending[shard].get();
+	}
+
+	std::vector<size_t> next(shards.size(), 0);
+
+	std::vector<Result> merged;
+
+	merged.reserve(names.size());
+
+	for (size_t i = 0; i < names.size(); i++)
+		merged.push_back(results[placement[i]][next[placement[i]]++]);
+
+	return merged;
+}
+
+std::vector<bool> ShardedStorage::insertKeys(const std::vector<std::string>& keys) {
+
+	return fanOut<bool>(keys, [](Database& shard, const std::vector<std::string>& part) { return Storage::insertKeys(shard, part); });
+}
+
+std::vector<bool> ShardedStorage::extendKeys(const std::vector<std::string>& keys, long long expiresAt) {
+
+	return fanOut<bool>(keys, [expiresAt](Database& shard, const std::vector<std::string>& part) { return Storage::extendKeys(shard, part, expiresAt); });
+}
+
+// A user and its key can live on different shards with no shared transaction, so the codes
+// are looked up in one batch per user shard and then extended in one batch per key shard.
+std::vector<bool> ShardedStorage::extendUserKeys(const std::vector<std::string>& users, long long expiresAt, std::vector<std::string>& codes) {
+
+	codes = fanOut<std::string>(users, [](Database& shard, const std::vector<std::string>& part) { return shard.userCodes(part); });
+
+	std::vector<std::string> found;
+
+	for (const auto& code : codes) {
+
+		if (!code.empty())
+			found.push_back(code);
+	}
+
+	auto extendedFound = extendKeys(found, expiresAt);
+
+	std::vector<bool> extended;
+
+	size_t next = 0;
+
+	for (const auto& code : codes)
+		extended.push_back(!code.empty() && extendedFound[next++]);
+
+	return extended;
+}
+
+// Each shard expires up to the limit, so a batch can come back larger than asked for; the
+// caller only stops once a batch comes back short, which means every shard is done.
+std::vector<std::string> ShardedStorage::expire(long long now, size_t limit) {
+
+	std::vector<std::future<std::vector<std::string>>> pending;
+
+	for (auto& shard : shards)
+		pending.push_back(std::async(std::launch::async, [&, now, limit] { return Storage::expire(*shard, now, limit); }));
+
+	std::vector<std::string> expired;
+
+	for (auto& part : pending) {
+
+		auto names = part.get();
+
+		expired.insert(expired.end(), names.begin(), names.end());
+	}
+
+	return expired;
+}
+
+std::string ShardedStorage::reserveKey(const std::string& code, long long expiresAt, KeyRecord& previous) {
+
+	return Storage::reserveKey(shardFor(code), code, expiresAt, previous);
+}
+
+void ShardedStorage::releaseKey(const KeyRecord& previous) {
+
+	Storage::releaseKey(shardFor(previous.name), previous);
+}
+
+bool ShardedStorage::addUser(const UserRecord& user) {
+
+	return Storage::addUser(shardFor(user.name), user);
+}
+
+std::optional<UserRecord> ShardedStorage::getUser(const std::string& name) {
+
+	return shardFor(name).getUser(name);
+}
+
+std::optional<KeyRecord> ShardedStorage::getKey(const std::string& name) {
+
+	return shardFor(name).getKey(name);
+}
+
+void ShardedStorage::listNames(std::vector<std::string>& users, std::vector<std::string>& keys) {
+
+	for (auto& shard : shards)
+		shard->listNames(users, keys);
+}
+
+std::vector<long long> ShardedStorage::pendingExpiries() {
+
+	std::vector<long long> deadlines;
+
+	for (auto& shard : shards) {
+
+		auto part = shard->pendingExpiries();
+
+		deadlines.insert(deadlines.end(), part.begin(), part.end());
+	}
+
+	std::sort(deadlines.begin(), deadlines.end());
+
+	deadlines.erase(std::unique(deadlines.begin(), deadlines.end()), deadlines.end());
+
+	return deadlines;
+}
+
+void ShardedStorage::setPassword(const std::string& name, const std::string& password) {
+
+	shardFor(name).setPassword(name, password);
+}
+
+// When the user and the key hash to different shards there is no shared transaction, so the
+// key is reserved first and put back if the user row can't be added. A crash in between
+// leaves a claimed key with no owner, never a user holding a key someone else can claim.
+std::string ShardedStorage::claim(const UserRecord& user, long long expiresAt) {
+
+	Database& userShard	= shardFor(user.name);
+	Database& keyShard	= shardFor(user.code);
+
+	if (&userShard == &keyShard)
+		return Storage::claim(userShard, user, expiresAt);
+
+	if (userShard.getUser(user.name))
+		return "User already exists";
+
+	KeyRecord previous;
+
+	std::string response = Storage::reserveKey(keyShard, user.code, expiresAt, previous);
+
+	if (!response.empty())
+		return response;
+
+	try {
+
+		if (Storage::addUser(userShard, user))
+			return "User successfully registered";
+	}
+	catch (...) {
+
+		Storage::releaseKey(keyShard, previous);
+
+		throw;
+	}
+
+	Storage::releaseKey(keyShard, previous);
+
+	return "User already exists";
+}
+
+namespace {
+
+	using Connection	= std::unique_ptr<sqlite3, int(*)(sqlite3*)>;
+	using Statement		= std::unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)>;
+
+	Connection open(const std::string& path, int flags) {
+
+		sqlite3* sql = nullptr;
+
+		int result = sqlite3_open_v2(path.c_str(), &sql, flags, nullptr);
+
+		Connection connection{ sql, sqlite3_close_v2 };
+
+		if (result != SQLITE_OK)
+			throw std::runtime_error("sqlite3_open_v2 failed for " + path + " with code " + std::to_string(result));
+
+		return connection;
+	}
+
+	Statement prepare(sqlite3* sql, const char* query) {
+
+		sqlite3_stmt* stmt = nullptr;
+
+		if (sqlite3_prepare_v2(sql, query, -1, &stmt, nullptr) != SQLITE_OK)
+			throw std::runtime_error("sqlite3_prepare_v2 failed with message " + std::string(sqlite3_errmsg(sql)));
+
+		return Statement{ stmt, sqlite3_finalize };
+	}
+
+	void execute(sqlite3* sql, const char* query) {
+
+		if (sqlite3_exec(sql, query, nullptr, nullptr, nullptr) != SQLITE_OK)
+			throw std::runtime_error("sqlite3_exec failed with message " + std::string(sqlite3_errmsg(sql)));
+	}
+
+	// Copies every row of a table, column for column, into whichever target its name hashes to.
+	void copyRows(sqlite3* source, const char* select, std::vector<Connection>& targets, const char* insert) {
+
+		auto rows = prepare(source, select);
+
+		std::vector<Statement> inserts;
+
+		for (auto& target : targets)
+			inserts.push_back(prepare(target.get(), insert));
+
+		int result;
+
+		while ((result = sqlite3_step(rows.get())) == SQLITE_ROW) {
+
+			std::string name = reinterpret_cast<const char*>(sqlite3_column_text(rows.get(), 0));
+
+			sqlite3_stmt* stmt = inserts[ShardedStorage::shardIndex(name, targets.size())].get();
+
+			for (int column = 0; column < sqlite3_column_count(rows.get()); column++)
+				sqlite3_bind_value(stmt, column + 1, sqlite3_column_value(rows.get(), column));
+
+			if (sqlite3_step(stmt) != SQLITE_DONE)
+				throw std::runtime_error("Failed to copy " + name);
+
+			sqlite3_reset(stmt);
+		}
+
+		if (result != SQLITE_DONE)
+			throw std::runtime_error("sqlite3_step failed with code " + std::to_string(result));
+	}
+}
+
+// The server must not be running. New shards are built next to the old ones and only renamed
+// into place once every row has been copied and committed.
+void ShardedStorage::reshard(const std::string& baseName, size_t fromCount, size_t toCount) {
+
+	if (fromCount == 0 || toCount == 0)
+		throw std::runtime_error("Shard count must be at least 1");
+
+	for (size_t shard = 0; shard < fromCount; shard++) {
+
+		std::string source = shardPath(baseName, shard, fromCount);
+
+		if (std::filesystem::exists(source + ".old"))
+			throw std::runtime_error("Found " + source + ".old from an interrupted reshard; restore it before resharding again");
+
+		if (!std::filesystem::exists(source))
+			throw std::runtime_error("Missing shard " + source);
+
+		// Brings an old file up to the current schema, so the copy below can read every column.
+		Database migrate{ source };
+	}
+
+	for (size_t shard = 0; shard < toCount; shard++) {
+
+		std::filesystem::remove(shardPath(baseName, shard, toCount) + ".new");
+
+		Database schema{ shardPath(baseName, shard, toCount) + ".new" };
+	}
+
+	std::vector<Connection> targets;
+
+	for (size_t shard = 0; shard < toCount; shard++) {
+
+		targets.push_back(open(shardPath(baseName, shard, toCount) + ".new", SQLITE_OPEN_READWRITE));
+
+		execute(targets.back().get(), "BEGIN;");
+	}
+
+	for (size_t shard = 0; shard < fromCount; shard++) {
+
+		auto source = open(shardPath(baseName, shard, fromCount), SQLITE_OPEN_READONLY);
+
+		copyRows(source.get(), "SELECT name, password, code FROM users;", targets,
+			"INSERT OR IGNORE INTO users (name, password, code) VALUES (?, ?, ?);");
+
+		copyRows(source.get(), "SELECT name, used, valid, lastValidated, product, channel, expiresAt FROM keys;", targets,
+			"INSERT OR IGNORE INTO keys (name, used, valid, lastValidated, product, channel, expiresAt) VALUES (?, ?, ?, ?, ?, ?, ?);");
+	}
+
+	for (auto& target : targets)
+		execute(target.get(), "COMMIT;");
+
+	targets.clear();
+
+	// The old files are only moved aside until every new one is in place, so a failure part
+	// way through can put them all back.
+	std::vector<std::string> movedAside;
+
+	std::vector<std::string> placed;
+
+	try {
+
+		for (size_t shard = 0; shard < fromCount; shard++) {
+
+			std::string source = shardPath(baseName, shard, fromCount);
+
+			std::filesystem::rename(source, source + ".old");
+
+			movedAside.push_back(source);
+		}
+
+		for (size_t shard = 0; shard < toCount; shard++) {
+
+			std::string target = shardPath(baseName, shard, toCount);
+
+			std::filesystem::rename(target + ".new", target);
+
+			placed.push_back(target);
+		}
+	}
+	catch (...) {
+
+		std::error_code ignored;
+
+		for (const auto& target : placed)
+			std::filesystem::rename(target, target + ".new", ignored);
+
+		for (const auto& source : movedAside)
+			std::filesystem::rename(source + ".old", source, ignored);
+
+		throw;
+	}
+
+	for (const auto& source : movedAside)
+		std::filesystem::remove(source + ".old");
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "Storage.h"
+#include "Database.h"
+
+// SQLite backend split over several database files. Users are placed by a hash of their
+// name and keys by a hash of the key, so each shard has its own read connections and its
+// own write queue. Batched writes are split by shard and applied in parallel.
+class ShardedStorage : public Storage
+{
+	std::vector<std::unique_ptr<Database>> shards;
+
+	Database& shardFor(const std::string& name);
+
+	template<typename Result, typename Apply>
+	std::vector<Result> fanOut(const std::vector<std::string>& names, Apply apply);
+
+protected:
+
+	std::vector<bool> insertKeys(const std::vector<std::string>& keys) override;
+
+	std::vector<bool> extendKeys(const std::vector<std::string>& keys, long long expiresAt) override;
+
+	std::vector<bool> extendUserKeys(const std::vector<std::string>& users, long long expiresAt, std::vector<std::string>& codes) override;
+
+	std::vector<std::string> expire(long long now, size_t limit) override;
+
+	std::string claim(const UserRecord& user, long long expiresAt) override;
+
+	std::string reserveKey(const std::string& code, long long expiresAt, KeyRecord& previous) override;
+
+	void releaseKey(const KeyRecord& previous) override;
+
+	bool addUser(const UserRecord& user) override;
+
+public:
+
+	static constexpr size_t readersPerShard = 4;
+
+	// Stable across runs and builds, unlike std::hash, since it decides where rows live.
+	static size_t shardIndex(const std::string& name, size_t shardCount);
+
+	static std::string shardPath(const std::string& baseName, size_t shard, size_t shardCount);
+
+	// Offline: copies every row from the current shard files into a new set and swaps them in.
+	static void reshard(const std::string& baseName, size_t fromCount, size_t toCount);
+
+	ShardedStorage(const std::string& baseName, size_t shardCount);
+
+	std::optional<UserRecord> getUser(const std::string& name) override;
+
+	std::optional<KeyRecord> getKey(const std::string& name) override;
+
+	void listNames(std::vector<std::string>& users, std::vector<std::string>& keys) override;
+
+	std::vector<long long> pendingExpiries() override;
+
+	void setPassword(const std::string& name, const std::string& password) override;
+};
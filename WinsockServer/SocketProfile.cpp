@@ -0,0 +1,101 @@
+#include "SocketProfile.h"
+#include <algorithm>
+#include <climits>
+
+bool applySocketProfile(SOCKET connection, const SocketProfile& profile) {
+
+	BOOL noDelay = profile.noDelay;
+
+	if (setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay)) == SOCKET_ERROR)
+		return false;
+
+	if (profile.sendBuffer && setsockopt(connection, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&profile.sendBuffer), sizeof(profile.sendBuffer)) == SOCKET_ERROR)
+		return false;
+
+	if (profile.sendTimeout && setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&profile.sendTimeout), sizeof(profile.sendTimeout)) == SOCKET_ERROR)
+		return false;
+
+	return true;
+}
+
+// sendBuffer holds the size last applied to the socket; the option is only set when it changes.
+bool followSendBacklog(SOCKET connection, const SocketProfile& profile, int& sendBuffer) {
+
+	if (!profile.maxSendBuffer)
+		return true;
+
+	ULONG idealBacklog = 0;
+
+	DWORD bytesReturned = 0;
+
+	if (WSAIoctl(connection, SIO_IDEAL_SEND_BACKLOG_QUERY, nullptr, 0, &idealBacklog, sizeof(idealBacklog), &bytesReturned, nullptr, nullptr) == SOCKET_ERROR)
+		return false;
+
+	int idealBuffer = std::clamp(static_cast<int>(std::min<ULONG>(idealBacklog, INT_MAX)), profile.minSendBuffer, profile.maxSendBuffer);
+
+	if (idealBuffer == sendBuffer)
+		return true;
+
+	if (setsockopt(connection, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&idealBuffer), sizeof(idealBuffer)) == SOCKET_ERROR)
+		return false;
+
+	sendBuffer = idealBuffer;
+
+	return true;
+}
+
+SendBacklogTracker::SendBacklogTracker(SOCKET connection, const SocketProfile& profile) : connection{ connection }, profile{ profile } {
+
+	applySocketProfile(connection, profile);
+
+	sendBuffer	= profile.sendBuffer;
+	event		= WSACreateEvent();
+
+	if (!profile.maxSendBuffer || event == WSA_INVALID_EVENT)
+		return;
+
+	followSendBacklog(connection, profile, sendBuffer);
+
+	arm();
+}
+
+SendBacklogTracker::~SendBacklogTracker() {
+
+	if (armed) {
+
+		CancelIoEx(reinterpret_cast<HANDLE>(connection), &overlapped);
+
+		DWORD bytesReturned = 0, flags = 0;
+
+		WSAGetOverlappedResult(connection, &overlapped, &bytesReturned, TRUE, &flags);
+	}
+
+	if (event != WSA_INVALID_EVENT)
+		WSACloseEvent(event);
+}
+
+void SendBacklogTracker::arm() {
+
+	overlapped			= WSAOVERLAPPED{};
+	overlapped.hEvent	= event;
+
+	DWORD bytesReturned = 0;
+
+	armed = WSAIoctl(connection, SIO_IDEAL_SEND_BACKLOG_CHANGE, nullptr, 0, nullptr, 0, &bytesReturned, &overlapped, nullptr) == 0 || WSAGetLastError() == WSA_IO_PENDING;
+}
+
+void SendBacklogTracker::update() {
+
+	if (!armed || WSAWaitForMultipleEvents(1, &event, FALSE, 0, FALSE) != WSA_WAIT_EVENT_0)
+		return;
+
+	DWORD bytesReturned = 0, flags = 0;
+
+	WSAGetOverlappedResult(connection, &overlapped, &bytesReturned, FALSE, &flags);
+
+	WSAResetEvent(event);
+
+	followSendBacklog(connection, profile, sendBuffer);
+
+	arm();
+}
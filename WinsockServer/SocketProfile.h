@@ -0,0 +1,54 @@
+#pragma once
+
+#include <WinSock2.h>
+#include <ws2tcpip.h>
+#include <mstcpip.h>
+
+// Socket options for one class of connection. Control connections only ever carry short
+// requests and replies, so they get a small fixed send buffer. Bulk connections start at
+// minSendBuffer and then track the ideal send backlog reported by the stack, which keeps
+// just enough queued to fill the path while bounding the memory a slow client can pin. A send
+// that makes no progress for sendTimeout milliseconds fails, so a stalled reader is dropped.
+struct SocketProfile {
+
+	bool	noDelay;
+	int		sendBuffer;
+	int		minSendBuffer;
+	int		maxSendBuffer;
+	DWORD	sendTimeout;
+};
+
+const SocketProfile controlProfile	{ true, 16 * 1024, 0, 0, 0 };
+
+const SocketProfile bulkProfile		{ true, 64 * 1024, 64 * 1024, 4 * 1024 * 1024, 30 * 1000 };
+
+bool applySocketProfile(SOCKET connection, const SocketProfile& profile);
+
+bool followSendBacklog(SOCKET connection, const SocketProfile& profile, int& sendBuffer);
+
+// Applies a bulk profile and keeps the send buffer at the ideal send backlog. The stack signals every
+// change of the estimate through SIO_IDEAL_SEND_BACKLOG_CHANGE, so update() only queries and
+// resizes the buffer when that notification has fired, not on every send.
+class SendBacklogTracker
+{
+	SOCKET					connection;
+	const SocketProfile&	profile;
+	WSAEVENT				event;
+	WSAOVERLAPPED			overlapped{};
+	bool					armed		= false;
+	int						sendBuffer	= 0;
+
+	void arm();
+
+public:
+
+	SendBacklogTracker(SOCKET connection, const SocketProfile& profile);
+
+	~SendBacklogTracker();
+
+	SendBacklogTracker(const SendBacklogTracker& other)				= delete;
+
+	SendBacklogTracker& operator=(const SendBacklogTracker& other)	= delete;
+
+	void update();
+};
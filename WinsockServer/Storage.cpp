@@ -0,0 +1,154 @@
+#include "Storage.h"
+#include "KnownNames.h"
+#include "KeyEvents.h"
+
+std::string Storage::addKey(const std::string& key) {
+
+	if (key.length() < 8)
+		return std::string("Key too short");
+
+	if (key.length() > 25)
+		return std::string("Key too long");
+
+	KeyImport result;
+
+	importKeys({ key }, result);
+
+	return std::string(result.added ? "Key added" : "Key already exists");
+}
+
+std::string Storage::claimKey(const UserRecord& user, long long expiresAt) {
+
+	std::string response = claim(user, expiresAt);
+
+	if (response != "User successfully registered")
+		return response;
+
+	knownNames().addUser(user.name);
+
+	keyEvents().publish(KeyEvent::Validated, user.code);
+
+	return response;
+}
+
+void Storage::importKeys(const std::vector<std::string>& keys, KeyImport& result) {
+
+	std::vector<std::string> accepted;
+
+	for (const auto& key : keys) {
+
+		if (key.length() < 8 || key.length() > 25)
+			result.rejected.push_back(key);
+		else
+			accepted.push_back(key);
+	}
+
+	if (accepted.empty())
+		return;
+
+	auto added = insertKeys(accepted);
+
+	for (size_t i = 0; i < accepted.size(); i++) {
+
+		if (!added[i]) {
+
+			result.duplicates.push_back(accepted[i]);
+
+			continue;
+		}
+
+		knownNames().addKey(accepted[i]);
+
+		keyEvents().publish(KeyEvent::Added, accepted[i]);
+
+		result.added++;
+	}
+}
+
+size_t Storage::validateKeys(const std::vector<std::string>& names, bool byUser, long long expiresAt, std::string& outcomes) {
+
+	std::vector<std::string> keys;
+
+	std::vector<const std::string*> owners;
+
+	for (const auto& name : names) {
+
+		if (byUser && !knownNames().mightHaveUser(name)) {
+
+			outcomes += name + " user not found\n";
+
+			continue;
+		}
+
+		keys.push_back(name);
+
+		owners.push_back(&name);
+	}
+
+	if (keys.empty())
+		return 0;
+
+	std::vector<bool> extended;
+
+	if (byUser) {
+
+		std::vector<std::string> codes;
+
+		extended = extendUserKeys(keys, expiresAt, codes);
+
+		keys = std::move(codes);
+	}
+	else
+		extended = extendKeys(keys, expiresAt);
+
+	size_t validated = 0;
+
+	for (size_t i = 0; i < keys.size(); i++) {
+
+		if (byUser && keys[i].empty()) {
+
+			outcomes += *owners[i] + " user not found\n";
+
+			continue;
+		}
+
+		if (!extended[i]) {
+
+			outcomes += *owners[i] + " key not found\n";
+
+			continue;
+		}
+
+		outcomes += *owners[i] + " validated\n";
+
+		keyEvents().publish(KeyEvent::Validated, keys[i]);
+
+		validated++;
+	}
+
+	return validated;
+}
+
+// Invalidates in batches of batchSize, each committed on its own, so a large wave of
+// expiries never holds the write lock for long.
+std::vector<std::string> Storage::expireKeys(long long now, size_t batchSize) {
+
+	std::vector<std::string> names;
+
+	while (true) {
+
+		auto batch = expire(now, batchSize);
+
+		for (auto& name : batch) {
+
+			keyEvents().publish(KeyEvent::Invalidated, name);
+
+			names.push_back(std::move(name));
+		}
+
+		if (batch.size() < batchSize)
+			break;
+	}
+
+	return names;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+
+struct UserRecord {
+
+	std::string		name;
+	std::string		password;
+	std::string		code;
+};
+
+struct KeyRecord {
+
+	std::string		name;
+	bool			used		= false;
+	bool			valid		= false;
+	long long		expiresAt	= 0;
+	std::string		product		= "dawn";
+	std::string		channel		= "stable";
+};
+
+// Everything the server keeps about users and keys. Backends implement the lookups and the
+// raw writes; the public write operations here validate input and, once a backend reports
+// its changes durable, update the name filters and publish key events.
+class Storage
+{
+protected:
+
+	virtual std::vector<bool> insertKeys(const std::vector<std::string>& keys) = 0;
+
+	virtual std::vector<bool> extendKeys(const std::vector<std::string>& keys, long long expiresAt) = 0;
+
+	// Looks each user's key up and extends it in the same write. codes gets the key per user,
+	// or an empty string when there is no such user.
+	virtual std::vector<bool> extendUserKeys(const std::vector<std::string>& users, long long expiresAt, std::vector<std::string>& codes) = 0;
+
+	virtual std::vector<std::string> expire(long long now, size_t limit) = 0;
+
+	virtual std::string claim(const UserRecord& user, long long expiresAt) = 0;
+
+	// The two halves of claim, for when the user and the key live in different backends.
+	// reserveKey returns an empty string on success and hands back the key as it was, so a
+	// failed registration can put it back with releaseKey.
+	virtual std::string reserveKey(const std::string& code, long long expiresAt, KeyRecord& previous) = 0;
+
+	virtual void releaseKey(const KeyRecord& previous) = 0;
+
+	virtual bool addUser(const UserRecord& user) = 0;
+
+	// A backend built from other backends, like ShardedStorage, drives their hooks through
+	// these, since a derived class can only reach protected members of its own kind.
+	static std::vector<bool> insertKeys(Storage& backend, const std::vector<std::string>& keys) { return backend.insertKeys(keys); }
+
+	static std::vector<bool> extendKeys(Storage& backend, const std::vector<std::string>& keys, long long expiresAt) { return backend.extendKeys(keys, expiresAt); }
+
+	static std::vector<std::string> expire(Storage& backend, long long now, size_t limit) { return backend.expire(now, limit); }
+
+	static std::string reserveKey(Storage& backend, const std::string& code, long long expiresAt, KeyRecord& previous) { return backend.reserveKey(code, expiresAt, previous); }
+
+	static void releaseKey(Storage& backend, const KeyRecord& previous) { backend.releaseKey(previous); }
+
+	static bool addUser(Storage& backend, const UserRecord& user) { return backend.addUser(user); }
+
+	static std::string claim(Storage& backend, const UserRecord& user, long long expiresAt) { return backend.claim(user, expiresAt); }
+
+public:
+
+	static constexpr long long keyLifetime = 30LL * 24 * 60 * 60;
+
+	struct KeyImport {
+
+		size_t						added = 0;
+		std::vector<std::string>	duplicates;
+		std::vector<std::string>	rejected;
+	};
+
+	Storage() = default;
+
+	virtual ~Storage() = default;
+
+	Storage(const Storage& other)				= delete;
+
+	Storage& operator=(const Storage& other)	= delete;
+
+	virtual std::optional<UserRecord> getUser(const std::string& name) = 0;
+
+	virtual std::optional<KeyRecord> getKey(const std::string& name) = 0;
+
+	virtual void listNames(std::vector<std::string>& users, std::vector<std::string>& keys) = 0;
+
+	virtual std::vector<long long> pendingExpiries() = 0;
+
+	virtual void setPassword(const std::string& name, const std::string& password) = 0;
+
+	// Adds the user and claims its unused key atomically. Returns the registration response.
+	std::string claimKey(const UserRecord& user, long long expiresAt);
+
+	std::string addKey(const std::string& key);
+
+	void importKeys(const std::vector<std::string>& keys, KeyImport& result);
+
+	size_t validateKeys(const std::vector<std::string>& names, bool byUser, long long expiresAt, std::string& outcomes);
+
+	std::vector<std::string> expireKeys(long long now, size_t batchSize = 1000);
+};
@@ -1,63 +1,58 @@
-#pragma once
-
-#include <string>
-#include "sqlite3.h"
-#include <stdexcept>
-#include <vector>
-#include <WinSock2.h>
-#include <ws2tcpip.h>
-
-class User
-{
-	std::string		name;
-	std::string		password;
-	std::string		code;
-	SOCKET			connection;
-	sqlite3*		sql;
-
-public:
-
-	User(SOCKET connection, const std::string& name = "", const std::string& password = "", sqlite3* sql = nullptr, const std::string& code = "");
-
-	std::string registerUser();
-
-	std::string login(std::vector<User>& usersLoggedIn);
-
-	std::string logout(std::vector<User>& usersLoggedIn);
-
-	bool userExists();
-
-	bool isLoggedIn(const std::vector<User>& usersLoggedIn);
-
-	bool correctPassword();
-
-
-	std::string getUserKey();
-
-	void setKeyUsed();
-
-	void setKeyValid();
-
-	bool keyExists();
-
-	bool isKeyUsed();
-
-	bool isKeyValid();
-
-	std::string getName() const {
-		return name;
-	}
-
-	std::string getPassword() const {
-		return password;
-	}
-
-	std::string getCode() const {
-		return code;
-	}
-
-	SOCKET getConnection() const {
-		return connection;
-	}
-};
-
+#pragma once
+
+#include <string>
+#include <stdexcept>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <WinSock2.h>
+#include <ws2tcpip.h>
+#include "Storage.h"
+
+class User
+{
+	std::string		name;
+	std::string		password;
+	std::string		code;
+	SOCKET			connection;
+	Storage*		storage;
+	long long		expiresAt = 0;
+
+	bool correctPassword(const UserRecord& record);
+
+public:
+
+	User(SOCKET connection, const std::string& name = "", const std::string& password = "", Storage* storage = nullptr, const std::string& code = "");
+
+	std::string registerUser();
+
+	std::string authenticate();
+
+	std::string login(std::unordered_map<std::string, User>& usersLoggedIn);
+
+	bool isLoggedIn(const std::unordered_map<std::string, User>& usersLoggedIn);
+
+	long long setKeyValid();
+
+	std::pair<std::string, std::string> getKeyEntitlement();
+
+	std::string getName() const {
+		return name;
+	}
+
+	std::string getPassword() const {
+		return password;
+	}
+
+	std::string getCode() const {
+		return code;
+	}
+
+	long long getExpiresAt() const {
+		return expiresAt;
+	}
+
+	SOCKET getConnection() const {
+		return connection;
+	}
+};
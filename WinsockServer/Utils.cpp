@@ -1,80 +1,205 @@
-#include "Utils.h"
-#include <fstream>
-#include <filesystem>
-
-bool getImageBytes(const std::string& imagePath, std::vector<char>& imageBytes) {
-
-	if (!std::filesystem::exists(imagePath))
-		return false;
-
-	std::ifstream ifile{ imagePath, std::ios::binary };
-
-	imageBytes.assign(std::istreambuf_iterator<char>(ifile), std::istreambuf_iterator<char>());
-
-	ifile.close();
-
-	return true;
-}
-
-bool sendImage(const std::string& path, SOCKET connection)
-{
-	std::vector<char> imageBytes;
-
-	if (getImageBytes(path, imageBytes)) {
-
-		auto size = imageBytes.size();
-
-		if (send(connection, reinterpret_cast<const char*>(&size), sizeof(size), 0) == SOCKET_ERROR)
-			return false;
-
-		if (send(connection, imageBytes.data(), size, 0) == SOCKET_ERROR)
-			return false;
-
-		return true;
-	}
-
-	return false;
-}
-
-bool getOffsets(const std::string& path, std::vector<uintptr_t>& offsets) {
-
-	if (!std::filesystem::exists(path))
-		return false;
-
-	std::ifstream ifile{ path, std::ios::beg };
-
-	std::string str;
-
-	while (std::getline(ifile, str)) {
-
-		unsigned int offset;
-
-		if (sscanf_s(str.c_str(), "%*s %x", &offset) != 1) {
-
-			ifile.close();
-
-			return false;
-		}
-
-		offsets.push_back(static_cast<uintptr_t>(offset));
-	}
-
-	ifile.close();
-
-	return true;
-}
-
-bool sendOffsets(const std::string& path, SOCKET connection) {
-
-	std::vector<uintptr_t> offsets;
-
-	if (getOffsets(path, offsets)) {
-
-		if (send(connection, reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uintptr_t), 0) == SOCKET_ERROR)
-			return false;
-
-		return true;
-	}
-
-	return false;
-}
+#include "Utils.h"
+#include <Windows.h>
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
+
+bool getImageBytes(const std::string& imagePath, std::vector<char>& imageBytes) {
+
+	if (!std::filesystem::exists(imagePath))
+		return false;
+
+	std::ifstream ifile{ imagePath, std::ios::binary };
+
+	imageBytes.assign(std::istreambuf_iterator<char>(ifile), std::istreambuf_iterator<char>());
+
+	ifile.close();
+
+	return true;
+}
+
+bool getOffsets(const std::string& path, std::vector<uintptr_t>& offsets) {
+
+	if (!std::filesystem::exists(path))
+		return false;
+
+	std::ifstream ifile{ path, std::ios::beg };
+
+	std::string str;
+
+	while (std::getline(ifile, str)) {
+
+		unsigned int offset;
+
+		if (sscanf_s(str.c_str(), "%*s %x", &offset) != 1) {
+
+			ifile.close();
+
+			return false;
+		}
+
+		offsets.push_back(static_cast<uintptr_t>(offset));
+	}
+
+	ifile.close();
+
+	return true;
+}
+
+bool sendAll(SOCKET connection, const char* data, size_t size) {
+
+	while (size) {
+
+		int block = static_cast<int>(size > 0x40000000 ? 0x40000000 : size);
+
+		int sentBytes = send(connection, data, block, 0);
+
+		if (sentBytes == SOCKET_ERROR)
+			return false;
+
+		data += sentBytes;
+
+		size -= sentBytes;
+	}
+
+	return true;
+}
+
+// Reads size bytes of newline separated text and hands the non-empty lines to consumer in
+// batches of up to batchSize, so a long list is never held in memory at once.
+bool recvLines(SOCKET connection, size_t size, size_t batchSize, const std::function<void(std::vector<std::string>&)>& consumer) {
+
+	std::vector<char> buffer(64 * 1024);
+
+	std::vector<std::string> lines;
+
+	std::string partial;
+
+	auto addLine = [&](std::string line) {
+
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		if (line.empty())
+			return;
+
+		lines.push_back(std::move(line));
+
+		if (lines.size() >= batchSize) {
+
+			consumer(lines);
+
+			lines.clear();
+		}
+	};
+
+	while (size) {
+
+		int receivedBytes = recv(connection, buffer.data(), static_cast<int>(size < buffer.size() ? size : buffer.size()), 0);
+
+		if (receivedBytes <= 0)
+			break;
+
+		size -= receivedBytes;
+
+		const char* begin	= buffer.data();
+		const char* end		= buffer.data() + receivedBytes;
+
+		const char* newline;
+
+		while ((newline = std::find(begin, end, '\n')) != end) {
+
+			partial.append(begin, newline);
+
+			addLine(std::move(partial));
+
+			partial.clear();
+
+			begin = newline + 1;
+		}
+
+		partial.append(begin, end);
+	}
+
+	addLine(std::move(partial));
+
+	if (!lines.empty())
+		consumer(lines);
+
+	return size == 0;
+}
+
+// Passes size bytes of the file starting at offset to sender. The next block is read with an overlapped
+// ReadFile while the current one is being sent, so a transfer never holds more than two blocks of
+// bufferSize bytes and never needs a thread of its own for the read-ahead.
+bool sendFile(const std::string& path, size_t offset, size_t size, size_t bufferSize, const std::function<bool(const char*, size_t)>& sender) {
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	HANDLE event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+
+	if (!event) {
+
+		CloseHandle(file);
+
+		return false;
+	}
+
+	OVERLAPPED overlapped{};
+
+	bool pending = false;
+
+	auto startRead = [&](std::vector<char>& buffer, size_t length) {
+
+		overlapped				= OVERLAPPED{};
+		overlapped.Offset		= static_cast<DWORD>(offset);
+		overlapped.OffsetHigh	= static_cast<DWORD>(static_cast<unsigned long long>(offset) >> 32);
+		overlapped.hEvent		= event;
+
+		pending = ReadFile(file, buffer.data(), static_cast<DWORD>(length), nullptr, &overlapped) || GetLastError() == ERROR_IO_PENDING;
+
+		return pending;
+	};
+
+	auto finishRead = [&]() -> size_t {
+
+		DWORD length = 0;
+
+		bool read = pending && GetOverlappedResult(file, &overlapped, &length, TRUE);
+
+		pending = false;
+
+		offset += length;
+
+		return read ? length : 0;
+	};
+
+	std::vector<char> current(std::min(bufferSize, size)), next(current.size());
+
+	bool sent = true;
+
+	size_t length = (size && startRead(current, current.size())) ? finishRead() : 0;
+
+	while (size && length && sent) {
+
+		size -= length;
+
+		if (size)
+			startRead(next, std::min(bufferSize, size));
+
+		sent = sender(current.data(), length);
+
+		length = size ? finishRead() : 0;
+
+		std::swap(current, next);
+	}
+
+	CloseHandle(event);
+
+	CloseHandle(file);
+
+	return size == 0 && sent;
+}
@@ -1,9 +1,17 @@
-#pragma once
-
-#include <WinSock2.h>
-#include <ws2tcpip.h>
-#include <string>
-
-bool sendImage(const std::string& path, SOCKET connection);
-
-bool sendOffsets(const std::string& path, SOCKET connection);
\ No newline at end of file
+#pragma once
+
+#include <WinSock2.h>
+#include <ws2tcpip.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+bool getImageBytes(const std::string& imagePath, std::vector<char>& imageBytes);
+
+bool getOffsets(const std::string& path, std::vector<uintptr_t>& offsets);
+
+bool sendAll(SOCKET connection, const char* data, size_t size);
+
+bool recvLines(SOCKET connection, size_t size, size_t batchSize, const std::function<void(std::vector<std::string>&)>& consumer);
+
+bool sendFile(const std::string& path, size_t offset, size_t size, size_t bufferSize, const std::function<bool(const char*, size_t)>& sender);
\ No newline at end of file
@@ -1,120 +1,342 @@
-#pragma once
-
-#include <WinSock2.h>
-#include <ws2tcpip.h>
-#include <string>
-#include <stdexcept>
-#include <thread>
-#include <functional>
-#include <fstream>
-#include <ctime>
-
-#pragma comment (lib, "Ws2_32.lib")
-
-#pragma warning (disable : 4996)
-
-class WinsockServer
-{
-	WSADATA							wsaData;
-	SOCKET							listenSocket;
-	std::function<void(SOCKET)>		handlerPtr;
-	std::ofstream					logger;
-
-public:
-
-	WinsockServer(const char* port, std::function<void(SOCKET)> handlerPtr) : handlerPtr{ handlerPtr } {
-
-		if (WSAStartup(MAKEWORD(2, 2), &wsaData))
-			throw std::runtime_error("WSAStartup failed with code " + std::to_string(WSAGetLastError()));
-
-		ADDRINFO hints{}, *serverInfo;
-
-		hints.ai_family		= AF_INET;
-		hints.ai_socktype	= SOCK_STREAM;
-		hints.ai_protocol	= IPPROTO_TCP;
-
-		int status{};
-
-		if (status = getaddrinfo("192.168.0.49", port, &hints, &serverInfo))          
-			throw std::runtime_error("getaddrinfo failed with status: " + std::string(gai_strerrorA(status)));
-
-		listenSocket = socket(serverInfo->ai_family, serverInfo->ai_socktype, serverInfo->ai_protocol);
-
-		if (listenSocket == INVALID_SOCKET) {
-
-			freeaddrinfo(serverInfo);
-
-			WSACleanup();
-
-			throw std::runtime_error("Error creating socket with code " + std::to_string(WSAGetLastError()));
-		}
-
-		if (bind(listenSocket, serverInfo->ai_addr, serverInfo->ai_addrlen) == SOCKET_ERROR) {
-
-			closesocket(listenSocket);
-
-			freeaddrinfo(serverInfo);
-
-			WSACleanup();
-
-			throw std::runtime_error("Error binding socket with code " + std::to_string(WSAGetLastError()));
-		}
-
-		freeaddrinfo(serverInfo);
-
-		if (listen(listenSocket, SOMAXCONN) == SOCKET_ERROR) {
-
-			closesocket(listenSocket);
-
-			WSACleanup();
-
-			throw std::runtime_error("Error listening with code " + std::to_string(WSAGetLastError()));
-		}
-	}
-
-	~WinsockServer() {
-
-		closesocket(listenSocket);
-
-		WSACleanup();
-	}
-
-	WinsockServer(const WinsockServer& other)				= delete;
-
-	WinsockServer& operator=(const WinsockServer& other)	= delete;
-
-	void processConnection() {
-
-		SOCKADDR_IN incomingConnectionInfo{};
-		
-		int addrLen = sizeof(incomingConnectionInfo);
-
-		SOCKET connection = accept(listenSocket, reinterpret_cast<SOCKADDR*>(&incomingConnectionInfo), &addrLen);
-
-		if (connection) {
-
-			logConnection(incomingConnectionInfo);
-
-			std::thread thread(handlerPtr, connection);
-
-			thread.detach();
-		}
-	}
-
-	void logConnection(const SOCKADDR_IN& incomingConnectionInfo) {
-
-		logger.open("logs.txt", std::ios::binary | std::ios::app);
-
-		std::time_t connectionTime = std::time(nullptr);
-
-		char ipAddress[INET_ADDRSTRLEN]{};
-
-		if (inet_ntop(AF_INET, &incomingConnectionInfo.sin_addr, ipAddress, INET_ADDRSTRLEN) != nullptr) {
-
-			logger << std::ctime(&connectionTime) << ipAddress << "\n\n";
-		}
-
-		logger.close();
-	}
-};
-
+#pragma once
+
+#include <WinSock2.h>
+#include <ws2tcpip.h>
+#include <string>
+#include <stdexcept>
+#include <thread>
+#include <functional>
+#include <fstream>
+#include <ctime>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "Metrics.h"
+
+#pragma comment (lib, "Ws2_32.lib")
+
+#pragma warning (disable : 4996)
+
+class WinsockServer
+{
+	struct PendingConnection {
+
+		SOCKET									connection;
+		std::chrono::steady_clock::time_point	acceptedAt;
+	};
+
+	WSADATA							wsaData;
+	SOCKET							listenSocket;
+	std::function<void(SOCKET)>		handlerPtr;
+	std::function<bool(const SOCKADDR*)>	admissionPtr;
+	std::ofstream					logger;
+
+	std::vector<PendingConnection>	pending;
+
+	std::mutex														logMutex;
+	std::condition_variable											logReady;
+	std::deque<std::pair<std::time_t, SOCKADDR_IN>>					logQueue;
+	bool															logging = true;
+	std::thread														logThread;
+
+	std::atomic<long long>&			acceptedCount		= metrics.get("accept.accepted");
+	std::atomic<long long>&			acceptErrors		= metrics.get("accept.errors");
+	std::atomic<long long>&			acceptWakeups		= metrics.get("accept.wakeups");
+	std::atomic<long long>&			acceptMaxBurst		= metrics.get("accept.max_burst");
+	std::atomic<long long>&			deferredTimeouts	= metrics.get("accept.deferred_timeouts");
+	std::atomic<long long>&			dispatchedCount		= metrics.get("accept.dispatched");
+	std::atomic<long long>&			readyOnAccept		= metrics.get("accept.ready_on_accept");
+	std::atomic<long long>&			fastOpenEnabled		= metrics.get("accept.fast_open_enabled");
+	std::atomic<long long>&			refusedCount		= metrics.get("accept.refused");
+
+	static constexpr int			backlog			= 4096;
+	static constexpr auto			deferTimeout	= std::chrono::seconds(10);
+
+public:
+
+	WinsockServer(const char* port, std::function<void(SOCKET)> handlerPtr, bool fastOpen = true) : handlerPtr{ handlerPtr } {
+
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData))
+			throw std::runtime_error("WSAStartup failed with code " + std::to_string(WSAGetLastError()));
+
+		ADDRINFO hints{}, *serverInfo;
+
+		hints.ai_family		= AF_INET;
+		hints.ai_socktype	= SOCK_STREAM;
+		hints.ai_protocol	= IPPROTO_TCP;
+
+		int status{};
+
+		if (status = getaddrinfo("192.168.0.49", port, &hints, &serverInfo))          
+			throw std::runtime_error("getaddrinfo failed with status: " + std::string(gai_strerrorA(status)));
+
+		listenSocket = socket(serverInfo->ai_family, serverInfo->ai_socktype, serverInfo->ai_protocol);
+
+		if (listenSocket == INVALID_SOCKET) {
+
+			freeaddrinfo(serverInfo);
+
+			WSACleanup();
+
+			throw std::runtime_error("Error creating socket with code " + std::to_string(WSAGetLastError()));
+		}
+
+		if (bind(listenSocket, serverInfo->ai_addr, serverInfo->ai_addrlen) == SOCKET_ERROR) {
+
+			closesocket(listenSocket);
+
+			freeaddrinfo(serverInfo);
+
+			WSACleanup();
+
+			throw std::runtime_error("Error binding socket with code " + std::to_string(WSAGetLastError()));
+		}
+
+		freeaddrinfo(serverInfo);
+
+		// Lets clients put their CONN_REQ in the SYN, saving a round trip on the one-shot
+		// requests. Windows has no queue length for it, only on or off; older versions
+		// don't know the option, which is not an error.
+		if (fastOpen) {
+
+			DWORD enable = 1;
+
+			if (setsockopt(listenSocket, IPPROTO_TCP, TCP_FASTOPEN, reinterpret_cast<const char*>(&enable), sizeof(enable)) != SOCKET_ERROR)
+				fastOpenEnabled = 1;
+		}
+
+		if (listen(listenSocket, SOMAXCONN_HINT(backlog)) == SOCKET_ERROR) {
+
+			closesocket(listenSocket);
+
+			WSACleanup();
+
+			throw std::runtime_error("Error listening with code " + std::to_string(WSAGetLastError()));
+		}
+
+		u_long nonBlocking = 1;
+
+		if (ioctlsocket(listenSocket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+
+			closesocket(listenSocket);
+
+			WSACleanup();
+
+			throw std::runtime_error("Error setting non-blocking mode with code " + std::to_string(WSAGetLastError()));
+		}
+
+		logThread = std::thread{ &WinsockServer::writeLogs, this };
+	}
+
+	~WinsockServer() {
+
+		{
+			std::lock_guard<std::mutex> lock{ logMutex };
+
+			logging = false;
+		}
+
+		logReady.notify_one();
+
+		logThread.join();
+
+		for (const auto& connection : pending)
+			closesocket(connection.connection);
+
+		closesocket(listenSocket);
+
+		WSACleanup();
+	}
+
+	WinsockServer(const WinsockServer& other)				= delete;
+
+	WinsockServer& operator=(const WinsockServer& other)	= delete;
+
+	// Called with the peer address of every accepted connection; returning false closes it
+	// before any thread or log entry is spent on it.
+	void setAdmission(std::function<bool(const SOCKADDR*)> admission) {
+
+		admissionPtr = admission;
+	}
+
+	// Waits for activity on the listen socket or on accepted connections that have not sent
+	// anything yet. A ready listen socket is drained completely. An accepted connection only
+	// gets a handler thread once its request bytes have arrived, so idle connects never hold
+	// a thread.
+	void processConnection() {
+
+		std::vector<WSAPOLLFD> descriptors{ { listenSocket, POLLRDNORM, 0 } };
+
+		for (const auto& connection : pending)
+			descriptors.push_back({ connection.connection, POLLRDNORM, 0 });
+
+		if (WSAPoll(descriptors.data(), static_cast<ULONG>(descriptors.size()), 1000) == SOCKET_ERROR)
+			throw std::runtime_error("WSAPoll failed with code " + std::to_string(WSAGetLastError()));
+
+		auto now = std::chrono::steady_clock::now();
+
+		std::vector<PendingConnection> waiting;
+
+		for (size_t i = 0; i < pending.size(); i++) {
+
+			if (descriptors[i + 1].revents) {
+
+				dispatch(pending[i].connection);
+			}
+			else if (now - pending[i].acceptedAt >= deferTimeout) {
+
+				deferredTimeouts++;
+
+				closesocket(pending[i].connection);
+			}
+			else {
+
+				waiting.push_back(pending[i]);
+			}
+		}
+
+		pending = std::move(waiting);
+
+		if (descriptors[0].revents & POLLRDNORM)
+			drainAccepts(now);
+	}
+
+	void drainAccepts(std::chrono::steady_clock::time_point now) {
+
+		long long burst = 0;
+
+		size_t first = pending.size();
+
+		while (true) {
+
+			SOCKADDR_IN incomingConnectionInfo{};
+
+			int addrLen = sizeof(incomingConnectionInfo);
+
+			SOCKET connection = accept(listenSocket, reinterpret_cast<SOCKADDR*>(&incomingConnectionInfo), &addrLen);
+
+			if (connection == INVALID_SOCKET) {
+
+				if (WSAGetLastError() != WSAEWOULDBLOCK)
+					acceptErrors++;
+
+				break;
+			}
+
+			if (admissionPtr && !admissionPtr(reinterpret_cast<const SOCKADDR*>(&incomingConnectionInfo))) {
+
+				refusedCount++;
+
+				closesocket(connection);
+
+				continue;
+			}
+
+			burst++;
+
+			logConnection(incomingConnectionInfo);
+
+			pending.push_back({ connection, now });
+		}
+
+		dispatchReady(first);
+
+		acceptWakeups++;
+
+		acceptedCount += burst;
+
+		Metrics::setMax(acceptMaxBurst, burst);
+	}
+
+	// Connections whose request arrived with the handshake, as with TCP Fast Open, are
+	// readable straight away and don't need to wait for the next poll.
+	void dispatchReady(size_t first) {
+
+		if (first == pending.size())
+			return;
+
+		std::vector<WSAPOLLFD> descriptors;
+
+		for (size_t i = first; i < pending.size(); i++)
+			descriptors.push_back({ pending[i].connection, POLLRDNORM, 0 });
+
+		if (WSAPoll(descriptors.data(), static_cast<ULONG>(descriptors.size()), 0) == SOCKET_ERROR)
+			return;
+
+		std::vector<PendingConnection> waiting{ pending.begin(), pending.begin() + first };
+
+		for (size_t i = 0; i < descriptors.size(); i++) {
+
+			if (descriptors[i].revents & POLLRDNORM) {
+
+				readyOnAccept++;
+
+				dispatch(descriptors[i].fd);
+			}
+			else {
+
+				waiting.push_back(pending[first + i]);
+			}
+		}
+
+		pending = std::move(waiting);
+	}
+
+	void dispatch(SOCKET connection) {
+
+		u_long nonBlocking = 0;
+
+		ioctlsocket(connection, FIONBIO, &nonBlocking);
+
+		dispatchedCount++;
+
+		std::thread thread(handlerPtr, connection);
+
+		thread.detach();
+	}
+
+	void logConnection(const SOCKADDR_IN& incomingConnectionInfo) {
+
+		{
+			std::lock_guard<std::mutex> lock{ logMutex };
+
+			logQueue.emplace_back(std::time(nullptr), incomingConnectionInfo);
+		}
+
+		logReady.notify_one();
+	}
+
+	void writeLogs() {
+
+		std::unique_lock<std::mutex> lock{ logMutex };
+
+		while (logging || !logQueue.empty()) {
+
+			logReady.wait(lock, [&] { return !logging || !logQueue.empty(); });
+
+			auto entries = std::move(logQueue);
+
+			logQueue.clear();
+
+			lock.unlock();
+
+			logger.open("logs.txt", std::ios::binary | std::ios::app);
+
+			for (const auto& [connectionTime, incomingConnectionInfo] : entries) {
+
+				char ipAddress[INET_ADDRSTRLEN]{};
+
+				if (inet_ntop(AF_INET, &incomingConnectionInfo.sin_addr, ipAddress, INET_ADDRSTRLEN) != nullptr) {
+
+					logger << std::ctime(&connectionTime) << ipAddress << "\n\n";
+				}
+			}
+
+			logger.close();
+
+			lock.lock();
+		}
+	}
+};
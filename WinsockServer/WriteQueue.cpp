@@ -0,0 +1,129 @@
+#include "WriteQueue.h"
+#include <vector>
+#include <stdexcept>
+
+WriteQueue::WriteQueue(const std::string& databaseName, size_t maxBatch, std::chrono::microseconds window) :
+	maxBatch{ maxBatch },
+	window{ window },
+	commits{ metrics.get("writes.commits") },
+	applied{ metrics.get("writes.applied") },
+	maxBatchSize{ metrics.get("writes.max_batch") } {
+
+	if (sqlite3_open_v2(databaseName.c_str(), &sql, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, nullptr) != SQLITE_OK)
+		throw std::runtime_error("sqlite3_open_v2 failed with code " + std::to_string(sqlite3_errcode(sql)));
+
+	sqlite3_busy_timeout(sql, 5000);
+
+	writer = std::thread{ &WriteQueue::write, this };
+}
+
+WriteQueue::~WriteQueue() {
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		running = false;
+	}
+
+	writeReady.notify_all();
+
+	if (writer.joinable())
+		writer.join();
+
+	sqlite3_close_v2(sql);
+}
+
+void WriteQueue::enqueue(Write write) {
+
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		writes.push_back(std::move(write));
+	}
+
+	writeReady.notify_all();
+}
+
+void WriteQueue::execute(const char* query) {
+
+	char* msg = nullptr;
+
+	if (sqlite3_exec(sql, query, nullptr, nullptr, &msg) != SQLITE_OK) {
+
+		std::string error = msg;
+
+		sqlite3_free(msg);
+
+		throw std::runtime_error("sqlite3_exec failed with message " + error);
+	}
+}
+
+void WriteQueue::write() {
+
+	while (true) {
+
+		std::vector<Write> batch;
+
+		{
+			std::unique_lock<std::mutex> lock{ mutex };
+
+			writeReady.wait(lock, [&] { return !running || !writes.empty(); });
+
+			if (writes.empty())
+				return;
+
+			writeReady.wait_for(lock, window, [&] { return !running || writes.size() >= maxBatch; });
+
+			while (!writes.empty() && batch.size() < maxBatch) {
+
+				batch.push_back(std::move(writes.front()));
+
+				writes.pop_front();
+			}
+		}
+
+		std::vector<std::exception_ptr> errors(batch.size());
+
+		try {
+
+			execute("BEGIN IMMEDIATE;");
+
+			for (size_t i = 0; i < batch.size(); i++) {
+
+				execute("SAVEPOINT write;");
+
+				try {
+
+					batch[i].apply(sql);
+				}
+				catch (...) {
+
+					errors[i] = std::current_exception();
+
+					execute("ROLLBACK TO write;");
+				}
+
+				execute("RELEASE write;");
+			}
+
+			execute("COMMIT;");
+		}
+		catch (...) {
+
+			if (!sqlite3_get_autocommit(sql))
+				sqlite3_exec(sql, "ROLLBACK;", nullptr, nullptr, nullptr);
+
+			for (auto& error : errors)
+				error = std::current_exception();
+		}
+
+		commits++;
+
+		applied += batch.size();
+
+		Metrics::setMax(maxBatchSize, static_cast<long long>(batch.size()));
+
+		for (size_t i = 0; i < batch.size(); i++)
+			batch[i].complete(errors[i]);
+	}
+}
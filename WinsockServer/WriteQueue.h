@@ -0,0 +1,86 @@
+#pragma once
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <chrono>
+#include <string>
+#include "sqlite3.h"
+#include "Metrics.h"
+
+// Group commit for database writes. Writes submitted from any thread are collected for up
+// to window, or until maxBatch are waiting, and applied by one writer thread inside a single
+// transaction, each under its own savepoint so a failing write doesn't take the batch down
+// with it. A write's future is only fulfilled once the whole batch has committed.
+class WriteQueue
+{
+	struct Write {
+
+		std::function<void(sqlite3*)>			apply;
+		std::function<void(std::exception_ptr)>	complete;
+	};
+
+	sqlite3*							sql = nullptr;
+	size_t								maxBatch;
+	std::chrono::microseconds			window;
+
+	std::mutex							mutex;
+	std::condition_variable				writeReady;
+	std::deque<Write>					writes;
+	bool								running = true;
+	std::thread							writer;
+
+	std::atomic<long long>&				commits;
+	std::atomic<long long>&				applied;
+	std::atomic<long long>&				maxBatchSize;
+
+	void write();
+
+	void execute(const char* query);
+
+	void enqueue(Write write);
+
+public:
+
+	WriteQueue(const std::string& databaseName, size_t maxBatch, std::chrono::microseconds window);
+
+	~WriteQueue();
+
+	WriteQueue(const WriteQueue& other)				= delete;
+
+	WriteQueue& operator=(const WriteQueue& other)	= delete;
+
+	template <typename Function>
+	auto submit(Function function) -> std::future<decltype(function(nullptr))> {
+
+		using Result = decltype(function(nullptr));
+
+		auto promise = std::make_shared<std::promise<Result>>();
+
+		auto result = promise->get_future();
+
+		if constexpr (std::is_void_v<Result>) {
+
+			enqueue({
+				[function = std::move(function)](sqlite3* sql) { function(sql); },
+				[promise](std::exception_ptr error) { error ? promise->set_exception(error) : promise->set_value(); }
+			});
+		}
+		else {
+
+			auto value = std::make_shared<std::optional<Result>>();
+
+			enqueue({
+				[function = std::move(function), value](sqlite3* sql) { value->emplace(function(sql)); },
+				[promise, value](std::exception_ptr error) { error ? promise->set_exception(error) : promise->set_value(std::move(**value)); }
+			});
+		}
+
+		return result;
+	}
+};
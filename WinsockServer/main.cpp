@@ -1,290 +1,676 @@
-
-#include <iostream>
-#include "WinsockServer.h"
-#include <thread>
-#include <mutex>
-#include <vector>
-#include "Database.h"
-#include "User.h"
-#include "Timer.h"
-#include "Utils.h"
-
-#define LOGIN		0x5CD100F
-#define REGISTER	0x20CC1D
-#define ADDKEY      0x4411969
-#define VALIDATE    0x988CCD
-
-struct CONN_REQ {
-
-	ULONGLONG	requestType;
-	char		name[32];
-	char		password[32];
-	char		key[32];
-	char		extra[32];
-};
-
-std::mutex userMutex;
-
-std::vector<User> usersLoggedIn;
-
-bool clientDisconnected(SOCKET connection) {
-
-	char ping[64];
-
-	while (recv(connection, ping, sizeof(ping), 0)) {
-
-		if (send(connection, ping, sizeof(ping), 0) == SOCKET_ERROR)
-			return true;
-
-		return false;
-	}
-
-	return true;
-}
-
-void logoutThread() {
-
-	while (true) {
-
-		for (auto& user : usersLoggedIn) {
-
-			if (clientDisconnected(user.getConnection())) {
-
-				std::string name = user.getName();
-
-				userMutex.lock();
-
-				user.logout(usersLoggedIn);
-
-				userMutex.unlock();
-
-				std::cout << "User " << name << " disconnected.\n";
-
-				break;
-			}
-		}
-
-		Sleep(1000);
-	}
-}
-
-void invalidator() {
-
-	try {
-
-		Database database{ "data.db" };
-
-		database.open();
-
-		auto result = database.invalidate();
-
-		database.close();
-
-		if (result) {
-
-			std::cout << "Keys invalidated:\n";
-
-			for (const auto& name : result.value()) {
-
-				std::cout << name << std::endl;
-			}
-		}
-
-		Timer timer;
-
-		while (true) {
-
-			Sleep(3600000);
-
-			if (timer.elapsed() >= 4.0) {
-
-				database.open();
-
-				auto result = database.invalidate();
-
-				database.close();
-
-				if (result) {
-
-					std::cout << "Keys invalidated:\n";
-
-					for (const auto& name : result.value()) {
-
-						std::cout << name << std::endl;
-					}
-				}
-
-				timer.reset();
-			}
-		}
-	}
-	catch (std::exception& ex) {
-
-		std::cerr << "Invalidator thread exception: " << ex.what() << std::endl;
-
-	}
-}
-
-void handleConnection(SOCKET connection) {
-
-	try {
-
-		static Database database{ "data.db" };
-
-		CONN_REQ request{};
-
-		int receivedBytes = recv(connection, reinterpret_cast<char*>(&request), sizeof(request), 0);
-
-		if (receivedBytes == SOCKET_ERROR) {
-
-			std::cerr << "recv Error. Code: " << WSAGetLastError() << std::endl;
-
-			return;
-		}
-
-		if (receivedBytes == 0) {
-
-			std::cerr << "Error: Connection closed.\n";
-
-			return;
-		}
-
-		database.open();
-
-		switch (request.requestType) {
-
-			case LOGIN:
-			{
-				User user{ connection, request.name, request.password, database.get() };
-
-				userMutex.lock();
-
-				std::string response = user.login(usersLoggedIn);
-
-				userMutex.unlock();
-
-				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
-					break;
-
-				if (response != "Logged in")
-					break;
-
-				static std::thread logout{ logoutThread };
-
-				std::cout << "User " << user.getName() << " connected.\n";
-
-				if (!sendImage("C:\\Users\\grgic\\Desktop\\dawn\\Dawn.exe", connection)) {
-
-					std::cout << "Failed to send image.\n";
-
-					break;
-				}
-
-				std::cout << "Sent image bytes.\n";
-
-				if (!sendOffsets("C:\\Users\\grgic\\Desktop\\dawn\\offsets.txt", connection)) {
-
-					std::cout << "Failed to send offsets.\n";
-
-					break;
-				}
-
-				std::cout << "Sent offsets.\n";
-
-				break;
-			}
-			case REGISTER:
-			{
-				User user{ connection, request.name, request.password, database.get(), request.key };
-
-				std::string response = user.registerUser();
-
-				if (response == "User successfully registered")
-					std::cout << "User " << user.getName() << " registered.\n";
-
-				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
-					break;
-
-				break;
-			}
-			case ADDKEY:
-			{
-				std::string adminName = "Filip", adminPassword = "mojaSifra";
-
-				std::string response = "Error";
-
-				if (adminName == request.name && adminPassword == request.password) {
-
-					response = database.addKey(request.key);
-
-					if (response == "Key added")
-						std::cout << response << std::endl;
-				}
-
-				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
-					break;
-
-				break;
-			}
-			case VALIDATE:
-			{
-				std::string adminName = "Filip", adminPassword = "mojaSifra";
-
-				std::string response = "Error";
-
-				if (adminName == request.name && adminPassword == request.password) {
-
-					User user{ connection, request.extra, nullptr, database.get(), request.key };
-
-					user.setKeyValid();
-
-					response = "Key validated";
-				}
-				
-				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
-					break;
-
-				break;
-			}
-			default:
-			{
-				std::string response = "Unknown request";
-
-				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
-					break;
-
-				break;
-			}
-		}
-
-		database.close();
-
-	}
-	catch (std::exception& ex) {
-
-		std::cerr << ex.what() << std::endl;
-	}
-}
-
-int main() {
-
-	try {
-
-		WinsockServer server{ "8401", handleConnection };
-
-		std::thread invalidateKeys{ invalidator };
-
-		while (true) {
-
-			server.processConnection();
-		}
-	}
-	catch (std::exception& ex) {
-
-		std::cerr << ex.what();
-
-		return -1;
-	}
-
-	return 0;
+
+#include <iostream>
+#include "WinsockServer.h"
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include "Database.h"
+#include "MemoryStorage.h"
+#include "ShardedStorage.h"
+#include "User.h"
+#include "Utils.h"
+#include "Protocol.h"
+#include "PayloadCatalog.h"
+#include "BandwidthScheduler.h"
+#include "SocketProfile.h"
+#include "Metrics.h"
+#include "KnownNames.h"
+#include "RateLimiter.h"
+#include "ConcurrencyLimiter.h"
+#include "SessionTokens.h"
+#include "SessionRegistry.h"
+#include "KeyEvents.h"
+#include "KeyGenerator.h"
+#include <unordered_set>
+#include "ExpiryScheduler.h"
+
+std::unique_ptr<Storage> storage;
+
+std::unique_ptr<PayloadCatalog> payloads;
+
+std::unique_ptr<BandwidthScheduler> scheduler;
+
+std::unique_ptr<RateLimiter> addressLimiter;
+
+std::unique_ptr<RateLimiter> accountLimiter;
+
+std::unique_ptr<ConcurrencyLimiter> concurrencyLimiter;
+
+std::unique_ptr<SessionTokens> sessionTokens;
+
+std::unique_ptr<SessionRegistry> sessions;
+
+std::unique_ptr<ExpiryScheduler> expiryScheduler;
+
+std::shared_ptr<const Payload> findPayload(User& user, const char* requestedHash) {
+
+	auto [product, channel] = user.getKeyEntitlement();
+
+	Digest hash{};
+
+	std::memcpy(hash.data(), requestedHash, hash.size());
+
+	if (hash == Digest{})
+		return payloads->getCurrent(product, channel);
+
+	return payloads->find(product, channel, hash);
+}
+
+// Logins and admin requests first, then downloads, then registrations and anything unknown.
+size_t priorityClass(ULONGLONG requestType) {
+
+	switch (requestType) {
+
+		case LOGIN:
+		case RESUME:
+		case VALIDATE:
+		case ADDKEY:
+		case STATS:
+		case REBUILD:
+		case IMPORTKEYS:
+		case GENKEYS:
+		case VALIDATEALL:
+			return 0;
+
+		case MANIFEST:
+		case CHUNKS:
+			return 1;
+
+		default:
+			return 2;
+	}
+}
+
+// Uniqueness is left to the unique index: each batch is inserted as is and the candidates
+// that already existed are simply generated again in the next one. Stops early only once a
+// whole batch comes back as duplicates, which means the key space is exhausted.
+size_t generateKeys(SOCKET connection, Storage& storage, KeyGenerator& generator, size_t count) {
+
+	size_t generated = 0;
+
+	while (generated < count) {
+
+		size_t wanted = std::min<size_t>(10000, count - generated);
+
+		std::unordered_set<std::string> candidates;
+
+		for (size_t attempts = 0; candidates.size() < wanted && attempts < wanted * 16; attempts++)
+			candidates.insert(generator.next());
+
+		std::vector<std::string> batch{ candidates.begin(), candidates.end() };
+
+		Storage::KeyImport result;
+
+		storage.importKeys(batch, result);
+
+		if (!result.added)
+			break;
+
+		generated += result.added;
+
+		std::unordered_set<std::string> existing(result.duplicates.begin(), result.duplicates.end());
+
+		std::string lines;
+
+		for (const auto& key : batch) {
+
+			if (!existing.count(key))
+				lines += key + "\n";
+		}
+
+		if (!sendAll(connection, lines.c_str(), lines.length()))
+			break;
+	}
+
+	return generated;
+}
+
+bool clientDisconnected(SOCKET connection) {
+
+	char ping[64];
+
+	while (recv(connection, ping, sizeof(ping), 0)) {
+
+		if (send(connection, ping, sizeof(ping), 0) == SOCKET_ERROR)
+			return true;
+
+		return false;
+	}
+
+	return true;
+}
+
+void logoutThread() {
+
+	while (true) {
+
+		for (const auto& user : sessions->snapshot()) {
+
+			if (clientDisconnected(user.getConnection()) && sessions->logout(user.getName()))
+				std::cout << "User " << user.getName() << " disconnected.\n";
+		}
+
+		Sleep(1000);
+	}
+}
+
+void invalidator(long long now) {
+
+	auto names = storage->expireKeys(now);
+
+	if (!names.empty()) {
+
+		std::cout << "Keys invalidated:\n";
+
+		for (const auto& name : names) {
+
+			std::cout << name << std::endl;
+		}
+	}
+}
+
+void handleConnection(SOCKET connection) {
+
+	try {
+
+		applySocketProfile(connection, controlProfile);
+
+		CONN_REQ request{};
+
+		int receivedBytes = recv(connection, reinterpret_cast<char*>(&request), sizeof(request), 0);
+
+		if (receivedBytes == SOCKET_ERROR) {
+
+			std::cerr << "recv Error. Code: " << WSAGetLastError() << std::endl;
+
+			return;
+		}
+
+		if (receivedBytes == 0) {
+
+			std::cerr << "Error: Connection closed.\n";
+
+			return;
+		}
+
+		SOCKADDR_STORAGE peer{};
+
+		int peerLength = sizeof(peer);
+
+		getpeername(connection, reinterpret_cast<SOCKADDR*>(&peer), &peerLength);
+
+		if (request.name[0] && !accountLimiter->admit(reinterpret_cast<const SOCKADDR*>(&peer), std::string(request.name, strnlen(request.name, sizeof(request.name))))) {
+
+			std::string response = "Too many requests";
+
+			send(connection, response.c_str(), response.length(), 0);
+
+			return;
+		}
+
+		auto permit = concurrencyLimiter->acquire(priorityClass(request.requestType));
+
+		if (!permit) {
+
+			std::string response = "Server busy";
+
+			send(connection, response.c_str(), response.length(), 0);
+
+			return;
+		}
+
+		switch (request.requestType) {
+
+			case LOGIN:
+			{
+				User user{ connection, request.name, request.password, storage.get() };
+
+				std::string response = user.authenticate();
+
+				SESSION_TOKEN token{};
+
+				if (response == "Authenticated")
+					response = sessions->login(user, token);
+
+				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
+					break;
+
+				if (response != "Logged in")
+					break;
+
+				if (send(connection, reinterpret_cast<const char*>(&token), sizeof(token), 0) == SOCKET_ERROR)
+					break;
+
+				permit.release();
+
+				static std::thread logout{ logoutThread };
+
+				std::cout << "User " << user.getName() << " connected.\n";
+
+				auto [product, channel] = user.getKeyEntitlement();
+
+				auto payload = payloads->getCurrent(product, channel);
+
+				if (!payload) {
+
+					std::cout << "No image for " << product << "/" << channel << ".\n";
+
+					IMAGE_HDR header{ IMAGE_GONE };
+
+					send(connection, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+
+					break;
+				}
+
+				BandwidthScheduler::Flow flow{ *scheduler, connection };
+
+				if (!payload->sendImage(flow, request.extra)) {
+
+					std::cout << "Failed to send image.\n";
+
+					break;
+				}
+
+				std::cout << "Sent image bytes.\n";
+
+				if (!payload->sendOffsets(flow)) {
+
+					std::cout << "Failed to send offsets.\n";
+
+					break;
+				}
+
+				std::cout << "Sent offsets.\n";
+
+				break;
+			}
+			case RESUME:
+			{
+				std::string name(request.name, strnlen(request.name, sizeof(request.name)));
+
+				SESSION_TOKEN token{};
+
+				std::memcpy(&token, request.key, sizeof(token));
+
+				SESSION_TOKEN next{};
+
+				std::string code, response = sessions->resume(connection, name, token, code, next);
+
+				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
+					break;
+
+				if (response != "Resumed")
+					break;
+
+				if (send(connection, reinterpret_cast<const char*>(&next), sizeof(next), 0) == SOCKET_ERROR)
+					break;
+
+				std::cout << "User " << name << " resumed.\n";
+
+				break;
+			}
+			case REGISTER:
+			{
+				User user{ connection, request.name, request.password, storage.get(), request.key };
+
+				std::string response = user.registerUser();
+
+				if (response == "User successfully registered") {
+
+					expiryScheduler->schedule(user.getExpiresAt());
+
+					std::cout << "User " << user.getName() << " registered.\n";
+				}
+
+				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
+					break;
+
+				break;
+			}
+			case ADDKEY:
+			{
+				std::string adminName = "Filip", adminPassword = "mojaSifra";
+
+				std::string response = "Error";
+
+				if (adminName == request.name && adminPassword == request.password) {
+
+					response = storage->addKey(request.key);
+
+					if (response == "Key added")
+						std::cout << response << std::endl;
+				}
+
+				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
+					break;
+
+				break;
+			}
+			case IMPORTKEYS:
+			{
+				std::string adminName = "Filip", adminPassword = "mojaSifra";
+
+				std::string response = "Error";
+
+				if (adminName == request.name && adminPassword == request.password) {
+
+					ULONGLONG size{};
+
+					std::memcpy(&size, request.key, sizeof(size));
+
+					Storage::KeyImport result;
+
+					// The upload runs at the client's pace, so it must not count as one latency sample.
+					permit.release();
+
+					bool complete = recvLines(connection, static_cast<size_t>(size), 10000, [&](std::vector<std::string>& keys) { storage->importKeys(keys, result); });
+
+					response = std::string(complete ? "" : "Key list truncated\n") +
+						"Keys imported: " + std::to_string(result.added) + "\n"
+						"Keys rejected: " + std::to_string(result.rejected.size()) + "\n"
+						"Duplicate keys: " + std::to_string(result.duplicates.size()) + "\n";
+
+					for (const auto& key : result.duplicates)
+						response += key + "\n";
+
+					std::cout << "Keys imported: " << result.added << std::endl;
+				}
+
+				sendAll(connection, response.c_str(), response.length());
+
+				break;
+			}
+			case GENKEYS:
+			{
+				std::string adminName = "Filip", adminPassword = "mojaSifra";
+
+				std::string response = "Error";
+
+				if (adminName == request.name && adminPassword == request.password) {
+
+					KEY_GENERATION generation{};
+
+					std::memcpy(&generation, request.key, sizeof(generation));
+
+					std::string alphabet(request.extra, strnlen(request.extra, sizeof(request.extra)));
+
+					if (alphabet.empty())
+						alphabet = KeyGenerator::defaultAlphabet;
+
+					if (generation.length < 8 || generation.length > 25 || !KeyGenerator::isValidAlphabet(alphabet) || generation.count > 1000000) {
+
+						response = "Invalid key format";
+					}
+					else {
+
+						KeyGenerator generator{ alphabet, static_cast<size_t>(generation.length) };
+
+						permit.release();
+
+						size_t generated = generateKeys(connection, *storage, generator, static_cast<size_t>(generation.count));
+
+						if (generated < generation.count)
+							response = "Error: only " + std::to_string(generated) + " of " + std::to_string(generation.count) + " keys generated\n";
+						else
+							response = "Keys generated: " + std::to_string(generated) + "\n";
+
+						std::cout << response;
+					}
+				}
+
+				sendAll(connection, response.c_str(), response.length());
+
+				break;
+			}
+			case VALIDATE:
+			{
+				std::string adminName = "Filip", adminPassword = "mojaSifra";
+
+				std::string response = "Error";
+
+				if (adminName == request.name && adminPassword == request.password) {
+
+					User user{ connection, request.extra, nullptr, storage.get(), request.key };
+
+					expiryScheduler->schedule(user.setKeyValid());
+
+					response = "Key validated";
+				}
+				
+				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
+					break;
+
+				break;
+			}
+			case VALIDATEALL:
+			{
+				std::string adminName = "Filip", adminPassword = "mojaSifra";
+
+				std::string response = "Error";
+
+				if (adminName == request.name && adminPassword == request.password) {
+
+					ULONGLONG size{};
+
+					std::memcpy(&size, request.key, sizeof(size));
+
+					bool byUser = std::string(request.extra, strnlen(request.extra, sizeof(request.extra))) == "users";
+
+					long long expiresAt = std::time(nullptr) + Storage::keyLifetime;
+
+					size_t validated = 0;
+
+					response.clear();
+
+					permit.release();
+
+					recvLines(connection, static_cast<size_t>(size), 10000, [&](std::vector<std::string>& names) { validated += storage->validateKeys(names, byUser, expiresAt, response); });
+
+					if (validated)
+						expiryScheduler->schedule(expiresAt);
+
+					response += "Keys validated: " + std::to_string(validated) + "\n";
+
+					std::cout << "Keys validated: " << validated << std::endl;
+				}
+
+				sendAll(connection, response.c_str(), response.length());
+
+				break;
+			}
+			case STATS:
+			{
+				std::string adminName = "Filip", adminPassword = "mojaSifra";
+
+				std::string response = "Error";
+
+				if (adminName == request.name && adminPassword == request.password)
+					response = metrics.report();
+
+				sendAll(connection, response.c_str(), response.length());
+
+				break;
+			}
+			case REBUILD:
+			{
+				std::string adminName = "Filip", adminPassword = "mojaSifra";
+
+				std::string response = "Error";
+
+				if (adminName == request.name && adminPassword == request.password) {
+
+					knownNames().rebuild(*storage);
+
+					response = "Filters rebuilt";
+				}
+
+				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
+					break;
+
+				break;
+			}
+			case MANIFEST:
+			case CHUNKS:
+			{
+				User user{ connection, request.name, request.password, storage.get() };
+
+				std::string response = user.authenticate();
+
+				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
+					break;
+
+				if (response != "Authenticated")
+					break;
+
+				auto payload = findPayload(user, request.extra);
+
+				permit.release();
+
+				BandwidthScheduler::Flow flow{ *scheduler, connection };
+
+				if (request.requestType == MANIFEST) {
+
+					if (!payload) {
+
+						MANIFEST_HDR header{ IMAGE_GONE };
+
+						send(connection, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+
+						break;
+					}
+
+					if (!payload->sendManifest(flow))
+						std::cout << "Failed to send manifest.\n";
+
+					break;
+				}
+
+				if (!payload) {
+
+					CHUNK_HDR header{ IMAGE_GONE };
+
+					send(connection, reinterpret_cast<const char*>(&header), sizeof(header), 0);
+
+					break;
+				}
+
+				CHUNK_RANGE range{};
+
+				std::memcpy(&range, request.key, sizeof(range));
+
+				if (!payload->sendChunks(flow, range))
+					std::cout << "Failed to send chunks.\n";
+
+				break;
+			}
+			default:
+			{
+				std::string response = "Unknown request";
+
+				if (send(connection, response.c_str(), response.length(), 0) == SOCKET_ERROR)
+					break;
+
+				break;
+			}
+		}
+
+	}
+	catch (std::exception& ex) {
+
+		std::cerr << ex.what() << std::endl;
+	}
+}
+
+int main(int argc, char* argv[]) {
+
+	try {
+
+		std::string backend = "--storage=sqlite";
+
+		size_t egressLimit = 0;
+
+		for (int i = 1; i < argc; i++) {
+
+			std::string argument = argv[i];
+
+			if (argument.rfind("--egress-limit=", 0) == 0)
+				egressLimit = std::stoull(argument.substr(15));
+			else
+				backend = argument;
+		}
+
+		if (backend.rfind("--reshard=", 0) == 0) {
+
+			size_t separator = backend.find(':');
+
+			if (separator == std::string::npos)
+				throw std::runtime_error("Expected --reshard=FROM:TO");
+
+			size_t fromCount	= std::stoul(backend.substr(10, separator - 10));
+			size_t toCount		= std::stoul(backend.substr(separator + 1));
+
+			ShardedStorage::reshard("data", fromCount, toCount);
+
+			std::cout << "Resharded " << fromCount << " to " << toCount << " shards" << std::endl;
+
+			return 0;
+		}
+
+		if (backend == "--storage=memory")
+			storage = std::make_unique<MemoryStorage>("data.log");
+		else if (backend == "--storage=sqlite")
+			storage = std::make_unique<Database>("data.db");
+		else if (backend.rfind("--storage=sqlite:", 0) == 0)
+			storage = std::make_unique<ShardedStorage>("data", std::stoul(backend.substr(17)));
+		else
+			throw std::runtime_error("Unknown storage backend " + backend);
+
+		knownNames().rebuild(*storage);
+
+		auto pendingExpiries = storage->pendingExpiries();
+
+		payloads = std::make_unique<PayloadCatalog>("catalog.txt", 512 * 1024 * 1024);
+
+		scheduler = std::make_unique<BandwidthScheduler>(64 * 1024, egressLimit);
+
+		addressLimiter = std::make_unique<RateLimiter>("ratelimit.address", 16, 10, 30);
+
+		accountLimiter = std::make_unique<RateLimiter>("ratelimit.account", 16, 5, 20);
+
+		concurrencyLimiter = std::make_unique<ConcurrencyLimiter>("concurrency", 64, 8, 1024, 3, 256, std::chrono::milliseconds(2000), std::chrono::milliseconds(500));
+
+		sessionTokens = std::make_unique<SessionTokens>(3600, 300);
+
+		sessions = std::make_unique<SessionRegistry>(*sessionTokens);
+
+		keyEvents().subscribe([](KeyEvent event, const std::string& key) {
+
+			if (event != KeyEvent::Invalidated)
+				return;
+
+			for (const auto& name : sessions->revokeKey(key))
+				std::cout << "User " << name << " disconnected, key expired.\n";
+		});
+
+		WinsockServer server{ "8401", handleConnection };
+
+		server.setAdmission([](const SOCKADDR* address) { return addressLimiter->admit(address); });
+
+		expiryScheduler = std::make_unique<ExpiryScheduler>(invalidator, pendingExpiries);
+
+		while (true) {
+
+			server.processConnection();
+		}
+	}
+	catch (std::exception& ex) {
+
+		std::cerr << ex.what();
+
+		return -1;
+	}
+
+	return 0;
 }
\ No newline at end of file